@@ -0,0 +1,173 @@
+//Batch mode: process many input files in a single process, each job is a line of a manifest file
+//with the same syntax as the command line "<input.sup> [<output.sup>] [OPTIONS ...]".
+//Jobs without options share the options given on the command line, parsed only once.
+
+struct t_batchJob {
+    std::vector<std::string> args; //storage for the strings referenced by cmd
+    t_cmd cmd = {};
+    int line = 0;
+    int result = -1;
+};
+
+struct t_batch {
+    const char* manifest = nullptr;
+    uint32_t threads = 0; //0 means one per hardware thread
+    t_cmd shared = {};
+    std::vector<t_batchJob> jobs;
+    t_traceOutput traceOutput; //standard output, shared by the traces of the jobs
+};
+
+//Split a manifest line in arguments, double quotes can be used for arguments containing spaces
+std::vector<std::string> splitManifestLine(const std::string& line) {
+    std::vector<std::string> args;
+    std::string arg;
+    bool inQuotes = false;
+    bool inArg = false;
+
+    for (char c : line) {
+        if (c == '"') {
+            inQuotes = !inQuotes;
+            inArg = true;
+        }
+        else if (!inQuotes && std::isspace((unsigned char)c)) {
+            if (inArg) {
+                args.push_back(arg);
+                arg.clear();
+                inArg = false;
+            }
+        }
+        else {
+            arg += c;
+            inArg = true;
+        }
+    }
+    if (inArg) {
+        args.push_back(arg);
+    }
+
+    return args;
+}
+
+//Usage: SupMover --batch <manifest> [--threads <n>] [OPTIONS ...]
+bool parseBatchCMD(int32_t argc, char** argv, t_batch& batch) {
+    if (argc < 3) return false;
+    batch.manifest = argv[2];
+
+    //Shared options are parsed as a normal command line without output file
+    std::vector<char*> sharedArgv = { argv[0], argv[2] };
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "threads" || arg == "--threads") {
+            if (i + 1 >= argc) return false;
+            batch.threads = (uint32_t)std::atoi(argv[++i]);
+        }
+        else {
+            sharedArgv.push_back(argv[i]);
+        }
+    }
+
+    if (!parseCMD((int32_t)sharedArgv.size(), sharedArgv.data(), batch.shared)) {
+        return false;
+    }
+    if (batch.shared.outputFile != nullptr) {
+        std::fprintf(stderr, "Unrecognized batch option %s\n", batch.shared.outputFile);
+        return false;
+    }
+
+    return true;
+}
+
+//Parse the arguments of a job, args[0] being the program name. The strings are referenced by the
+//parsed command line, so they must not move anymore.
+bool parseJobArgs(t_batchJob& job) {
+    std::vector<char*> jobArgv;
+    for (std::string& arg : job.args) {
+        jobArgv.push_back(&arg[0]);
+    }
+
+    return parseCMD((int32_t)jobArgv.size(), jobArgv.data(), job.cmd);
+}
+
+bool readManifest(t_batch& batch) {
+    std::ifstream manifest(batch.manifest);
+    if (!manifest.is_open()) {
+        std::fprintf(stderr, "Unable to open manifest file!\n");
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(manifest, line)) {
+        lineNumber++;
+
+        std::vector<std::string> args = splitManifestLine(line);
+        if (args.empty() || args[0][0] == '#') {
+            continue;
+        }
+
+        batch.jobs.emplace_back();
+        t_batchJob& job = batch.jobs.back();
+        job.args = args;
+        job.args.insert(job.args.begin(), "SupMover");
+        job.line = lineNumber;
+    }
+
+    //The strings must not move anymore once referenced by the parsed command lines
+    for (t_batchJob& job : batch.jobs) {
+        if (!parseJobArgs(job)) {
+            std::fprintf(stderr, "Error parsing line %d of the manifest\n", job.line);
+            return false;
+        }
+
+        bool onlyFiles = job.args.size() == 2
+                      || (job.args.size() == 3 && job.cmd.outputFile != nullptr);
+        if (onlyFiles) {
+            const char* outputFile = job.cmd.outputFile;
+            job.cmd = batch.shared;
+            job.cmd.inputFile = job.args[1].c_str();
+            job.cmd.outputFile = outputFile;
+        }
+    }
+
+    return true;
+}
+
+int processBatch(t_batch& batch) {
+    uint32_t threads = batch.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min(threads, (uint32_t)batch.jobs.size());
+
+    batch.traceOutput.file = stdout;
+    std::atomic<size_t> nextJob(0);
+    auto worker = [&batch, &nextJob]() {
+        size_t idx;
+        while ((idx = nextJob++) < batch.jobs.size()) {
+            batch.jobs[idx].cmd.sharedProcess = true;
+            batch.jobs[idx].result = processFile(batch.jobs[idx].cmd, nullptr, &batch.traceOutput);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (uint32_t i = 0; i < threads; i++) {
+        pool.emplace_back(worker);
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+
+    int failed = 0;
+    for (t_batchJob& job : batch.jobs) {
+        if (job.result == 0) {
+            std::fprintf(stderr, "OK     %s\n", job.cmd.inputFile);
+        }
+        else {
+            std::fprintf(stderr, "FAILED %s\n", job.cmd.inputFile);
+            failed++;
+        }
+    }
+    std::fprintf(stderr, "%zu jobs processed, %d failed\n", batch.jobs.size(), failed);
+
+    return failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,284 @@
+//Microbenchmarks of the segment codecs and end-to-end runs of every option over a generated stream.
+//Usage: bench [<display sets>]
+
+#include <iostream>
+#include <cctype>
+#include <cstdarg>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <thread>
+#include <vector>
+#include "pgs.hpp"
+#include "cmd.hpp"
+#include "stream.hpp"
+#include "palette.hpp"
+#include "rle.hpp"
+#include "trace.hpp"
+#include "stats.hpp"
+#include "plan.hpp"
+#include "process.hpp"
+#include "parallel.hpp"
+#include "index.hpp"
+#include "m2ts.hpp"
+#include "mkv.hpp"
+#include "inplace.hpp"
+#include "job.hpp"
+#include "batch.hpp"
+#include "generator.hpp"
+
+//Every allocation is counted, so the end-to-end runs can report the allocations per display set.
+//GCC cannot see that the replaced operator new and operator delete are paired.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size) {
+    allocations++;
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+//Keeps the compiler from dropping the benchmarked code
+volatile uint64_t sink = 0;
+
+struct t_benchTimer {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    double seconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+void printResult(const char* name, double seconds, size_t segments, size_t bytes) {
+    std::printf("%-22s %10.1f ns/seg %14.0f seg/s %10.1f MB/s\n", name,
+                seconds * 1e9 / (double)segments,
+                (double)segments / seconds,
+                (double)bytes / seconds / (1024.0 * 1024.0));
+}
+
+
+//Segment bodies used by the codec benchmarks
+t_PCS benchPCS(uint16_t compositionNumber, uint8_t compositionState, uint8_t numberOfObjects) {
+    t_PCS pcs = {};
+    pcs.width             = 1920;
+    pcs.height            = 1080;
+    pcs.frameRate         = 0x10;
+    pcs.compositionNumber = compositionNumber;
+    pcs.compositionState  = compositionState;
+    pcs.numberOfCompositionObjects = numberOfObjects;
+    for (int i = 0; i < numberOfObjects; i++) {
+        pcs.compositionObjects[i].objectID           = (uint16_t)i;
+        pcs.compositionObjects[i].windowID           = (uint8_t)i;
+        pcs.compositionObjects[i].horizontalPosition = 660;
+        pcs.compositionObjects[i].verticalPosition   = (uint16_t)(900 + i * 70);
+    }
+    return pcs;
+}
+
+t_WDS benchWDS(uint8_t numberOfWindows) {
+    t_WDS wds = {};
+    wds.numberOfWindows = numberOfWindows;
+    for (int i = 0; i < numberOfWindows; i++) {
+        wds.windows[i].id                 = (uint8_t)i;
+        wds.windows[i].horizontalPosition = 660;
+        wds.windows[i].verticalPosition   = (uint16_t)(900 + i * 70);
+        wds.windows[i].width              = 600;
+        wds.windows[i].height             = 60;
+    }
+    return wds;
+}
+
+t_PDS benchPDS(uint8_t numberOfPalettes) {
+    t_PDS pds = {};
+    pds.numberOfPalettes = numberOfPalettes;
+    for (int i = 0; i < numberOfPalettes; i++) {
+        pds.palettes[i].entryID = (uint8_t)i;
+        pds.palettes[i].valueY  = (uint8_t)(16 + i % 220);
+        pds.palettes[i].valueCb = 128;
+        pds.palettes[i].valueCr = 128;
+        pds.palettes[i].valueA  = (uint8_t)(i * 4);
+    }
+    return pds;
+}
+
+void benchCodecs(size_t iterations) {
+    std::vector<uint8_t> in(HEADER_SIZE + UINT16_MAX);
+    std::vector<uint8_t> out(HEADER_SIZE + UINT16_MAX);
+
+    t_header header = { 0x5047, 90000, 0, e_segmentType::pcs, 19 };
+    header.write(in.data());
+    t_benchTimer timer;
+    for (size_t i = 0; i < iterations; i++) {
+        t_header read = t_header::read(in.data());
+        read.pts += (uint32_t)i;
+        read.write(out.data());
+        sink += out[5];
+    }
+    printResult("header read/write", timer.seconds(), iterations, iterations * HEADER_SIZE);
+
+    t_PCS pcs = benchPCS(1, e_compositionState::epochStart, 2);
+    pcs.write(in.data());
+    timer = {};
+    for (size_t i = 0; i < iterations; i++) {
+        t_PCS read = t_PCS::read(in.data());
+        read.compositionNumber = (uint16_t)i;
+        read.write(out.data());
+        sink += out[6];
+    }
+    printResult("PCS read/write", timer.seconds(), iterations, iterations * (HEADER_SIZE + pcsSize(pcs)));
+
+    t_WDS wds = benchWDS(2);
+    wds.write(in.data());
+    timer = {};
+    for (size_t i = 0; i < iterations; i++) {
+        t_WDS read = t_WDS::read(in.data());
+        read.windows[0].verticalPosition = (uint16_t)i;
+        read.write(out.data());
+        sink += out[4];
+    }
+    printResult("WDS read/write", timer.seconds(), iterations, iterations * (HEADER_SIZE + wdsSize(wds)));
+
+    t_PDS pds = benchPDS(255);
+    pds.write(in.data());
+    timer = {};
+    for (size_t i = 0; i < iterations; i++) {
+        t_PDS read = t_PDS::read(in.data(), pdsSize(pds));
+        read.versionNumber = (uint8_t)i;
+        read.write(out.data());
+        sink += out[1];
+    }
+    printResult("PDS read/write", timer.seconds(), iterations, iterations * (HEADER_SIZE + pdsSize(pds)));
+
+    std::vector<uint32_t> values(4096);
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = (uint32_t)(i * 2654435761u);
+    }
+    size_t rounds = std::max((size_t)1, iterations / values.size()) * 16;
+    timer = {};
+    uint64_t sum = 0;
+    for (size_t r = 0; r < rounds; r++) {
+        for (uint32_t value : values) {
+            sum += swapEndianness(value) + swapEndianness((uint16_t)value);
+        }
+    }
+    sink += sum;
+    double seconds = timer.seconds();
+    std::printf("%-22s %10.2f ns/op\n", "swapEndianness", seconds * 1e9 / (double)(rounds * values.size() * 2));
+
+    timer = {};
+    sum = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        t_timestamp timestamp = ptsToTimestamp((uint32_t)(i * 3003));
+        sum += timestamp.hh + timestamp.mm + timestamp.ss + timestamp.ms;
+    }
+    sink += sum;
+    seconds = timer.seconds();
+    std::printf("%-22s %10.2f ns/op\n", "ptsToTimestamp", seconds * 1e9 / (double)iterations);
+}
+
+
+//Run the whole job as main does, best of some runs
+void benchOption(const char* name, std::vector<std::string> args, const t_streamInfo& info, size_t runs) {
+    std::vector<char*> argv;
+    for (std::string& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    t_cmd cmd = {};
+    if (!parseCMD((int32_t)argv.size(), argv.data(), cmd)) {
+        std::fprintf(stderr, "Invalid benchmark options for %s\n", name);
+        return;
+    }
+
+    double best = 0;
+    size_t bestAllocations = 0;
+    for (size_t i = 0; i < runs; i++) {
+        size_t allocationsBefore = allocations;
+        t_benchTimer timer;
+        if (processFile(cmd) != 0) {
+            std::fprintf(stderr, "Benchmark %s failed\n", name);
+            return;
+        }
+        double seconds = timer.seconds();
+        if (i == 0 || seconds < best) {
+            best = seconds;
+            bestAllocations = allocations - allocationsBefore;
+        }
+    }
+
+    std::printf("%-22s %10.1f ns/seg %14.0f seg/s %10.1f MB/s %8.2f allocs/ds\n", name,
+                best * 1e9 / (double)info.segments,
+                (double)info.segments / best,
+                (double)info.bytes / best / (1024.0 * 1024.0),
+                (double)bestAllocations / (double)info.displaySets);
+}
+
+int main(int32_t argc, char** argv) {
+    size_t events = 4000;
+    if (argc > 1) {
+        events = (size_t)std::max(1, std::atoi(argv[1]));
+    }
+
+    std::printf("Segment codecs\n");
+    benchCodecs(2000000);
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::string input = (dir / "supmover_bench_input.sup").string();
+    std::string output = (dir / "supmover_bench_output.sup").string();
+
+    t_generatorOptions options = {};
+    options.events = events;
+    options.interval = 2000;
+
+    t_streamInfo info = {};
+    FILE* file = std::fopen(input.c_str(), "wb");
+    bool generated = file != nullptr && generateStream(options, file, info);
+    if (file == nullptr || std::fclose(file) != 0 || !generated) {
+        std::fprintf(stderr, "Unable to write benchmark input file!\n");
+        return -1;
+    }
+    std::printf("\nEnd-to-end, %zu display sets, %zu segments, %.1f MB\n", info.displaySets, info.segments, (double)info.bytes / (1024.0 * 1024.0));
+
+    //The sections keep about half of the events
+    std::string list;
+    for (size_t ms = 0; ms < events * 2000; ms += 20000) {
+        list += std::to_string(ms) + "-" + std::to_string(ms + 9999) + ";";
+    }
+    list.pop_back();
+
+    size_t const runs = 3;
+    benchOption("delay",     { "bench", input, output, "--delay", "1500" }, info, runs);
+    benchOption("resync",    { "bench", input, output, "--resync", "25/23.976" }, info, runs);
+    benchOption("move",      { "bench", input, output, "--move", "0", "-100" }, info, runs);
+    benchOption("crop",      { "bench", input, output, "--crop", "100", "0", "100", "0" }, info, runs);
+    benchOption("tonemap",   { "bench", input, output, "--tonemap", "0.6" }, info, runs);
+    benchOption("cut_merge", { "bench", input, output, "--cut_merge", "--format", "secut", "--timemode", "ms", "--list", list }, info, runs);
+
+    std::remove(input.c_str());
+    std::remove(output.c_str());
+
+    return 0;
+}
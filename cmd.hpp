@@ -37,6 +37,17 @@ enum e_cutMergeFixMode : uint8_t {
     cut = 0  //cut begin and/or end to match current section
 };
 
+enum e_traceFormat : uint8_t {
+    text = 0,   //human readable tree of the display sets
+    ndjson = 1, //one JSON object for each segment
+    csv = 2     //one row for each segment
+};
+
+enum e_statsFormat : uint8_t {
+    human = 0,
+    json = 1   //a single line JSON object
+};
+
 struct t_cutMergeSection {
     uint32_t begin;
     uint32_t end;
@@ -61,6 +72,7 @@ struct t_cmd {
     const char* inputFile = nullptr;
     const char* outputFile = nullptr;
     bool trace = false;
+    e_traceFormat traceFormat = e_traceFormat::text;
     int32_t delay = 0;
     t_move move = {};
     t_crop crop = {};
@@ -68,6 +80,17 @@ struct t_cmd {
     bool addZero = false;
     double tonemap = 1;
     t_cutMerge cutMerge = {};
+    uint32_t threads = 1;
+    bool index = false;
+    bool recover = false;
+    bool stats = false;
+    e_statsFormat statsFormat = e_statsFormat::human;
+    std::vector<uint16_t> pids; //PGS tracks of a transport stream to process
+    bool allPids = false;
+    std::vector<uint64_t> tracks; //PGS tracks of a Matroska file to process
+    bool allTracks = false;
+    bool inPlace = false; //write the modified bytes back to the input file
+    bool sharedProcess = false; //job of batch or server mode, running alongside other jobs
 };
 
 
@@ -227,6 +250,25 @@ bool parseCMD(int32_t argc, char** argv, t_cmd& cmd) {
         if (arg == "trace" || arg == "--trace") {
             cmd.trace = true;
         }
+        else if (arg == "trace_format" || arg == "--trace_format") {
+            if (remaining < 1) return false;
+            std::string traceFormat = argv[i++];
+            toLower(traceFormat);
+
+            if (traceFormat == "text") {
+                cmd.traceFormat = e_traceFormat::text;
+            }
+            else if (traceFormat == "ndjson") {
+                cmd.traceFormat = e_traceFormat::ndjson;
+            }
+            else if (traceFormat == "csv") {
+                cmd.traceFormat = e_traceFormat::csv;
+            }
+            else {
+                return false;
+            }
+            cmd.trace = true;
+        }
         else if (arg == "delay" || arg == "--delay") {
             if (remaining < 1) return false;
             cmd.delay = (int32_t)round(atof(argv[i++]) * MS_TO_PTS_MULT);
@@ -287,6 +329,72 @@ bool parseCMD(int32_t argc, char** argv, t_cmd& cmd) {
             if (remaining < 1) return false;
             cmd.tonemap = std::atof(argv[i++]);
         }
+        else if (arg == "threads" || arg == "--threads") {
+            if (remaining < 1) return false;
+            cmd.threads = std::max(1, atoi(argv[i++]));
+        }
+        else if (arg == "index" || arg == "--index") {
+            cmd.index = true;
+        }
+        else if (arg == "in_place" || arg == "--in_place" || arg == "--in-place") {
+            cmd.inPlace = true;
+        }
+        else if (arg == "recover" || arg == "--recover") {
+            cmd.recover = true;
+        }
+        else if (arg == "stats" || arg == "--stats") {
+            cmd.stats = true;
+        }
+        else if (arg == "stats_format" || arg == "--stats_format") {
+            if (remaining < 1) return false;
+            std::string statsFormat = argv[i++];
+            toLower(statsFormat);
+
+            if (statsFormat == "text") {
+                cmd.statsFormat = e_statsFormat::human;
+            }
+            else if (statsFormat == "json") {
+                cmd.statsFormat = e_statsFormat::json;
+            }
+            else {
+                return false;
+            }
+            cmd.stats = true;
+        }
+        else if (arg == "pid" || arg == "--pid") {
+            if (remaining < 1) return false;
+            std::string pid = argv[i++];
+            toLower(pid);
+
+            if (pid == "all") {
+                cmd.allPids = true;
+            }
+            else {
+                char* end;
+                long value = std::strtol(pid.c_str(), &end, 0);
+                if (*end != '\0' || value < 0 || value > 0x1FFF) {
+                    return false;
+                }
+                cmd.pids.push_back((uint16_t)value);
+            }
+        }
+        else if (arg == "track" || arg == "--track") {
+            if (remaining < 1) return false;
+            std::string track = argv[i++];
+            toLower(track);
+
+            if (track == "all") {
+                cmd.allTracks = true;
+            }
+            else {
+                char* end;
+                unsigned long long value = std::strtoull(track.c_str(), &end, 10);
+                if (*end != '\0' || track.empty() || track[0] == '-' || value == 0) {
+                    return false;
+                }
+                cmd.tracks.push_back((uint64_t)value);
+            }
+        }
         else if (arg == "cut_merge" || arg == "--cut_merge") {
             cmd.cutMerge.doCutMerge = true;
         }
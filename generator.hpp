@@ -0,0 +1,192 @@
+//Synthetic stream generator: every event is a display set showing its objects followed by one
+//clearing them, the segments are written with the same codecs used to modify the real streams.
+//The object bitmaps are generated once from the seed and reused by all the events.
+
+struct t_generatorOptions {
+    size_t   events        = 1000;
+    uint16_t videoWidth    = 1920;
+    uint16_t videoHeight   = 1080;
+    uint8_t  objects       = 1;    //objects and windows of each event, one window for each object
+    uint16_t objectWidth   = 600;
+    uint16_t objectHeight  = 60;
+    uint8_t  palettes      = 16;   //palette entries of the PDS
+    size_t   epoch         = 1;    //events of an epoch, the following ones are acquisition points
+    uint32_t duration      = 3000; //ms an event is shown
+    uint32_t interval      = 4000; //ms between the beginning of two events
+    bool     cropped       = false;
+    bool     forced        = false;
+    uint32_t seed          = 1;
+};
+
+struct t_streamInfo {
+    size_t displaySets = 0;
+    size_t segments = 0;
+    size_t bytes = 0;
+};
+
+size_t pcsSize(const t_PCS& pcs) {
+    size_t size = 11;
+    for (int i = 0; i < pcs.numberOfCompositionObjects; i++) {
+        size += pcs.compositionObjects[i].croppedAndForcedFlag & e_objectFlags::cropped ? 16 : 8;
+    }
+    return size;
+}
+size_t wdsSize(const t_WDS& wds) {
+    return 1 + (size_t)wds.numberOfWindows * 9;
+}
+size_t pdsSize(const t_PDS& pds) {
+    return 2 + (size_t)pds.numberOfPalettes * PALETTE_ENTRY_SIZE;
+}
+
+//xorshift32, the same seed always generates the same stream
+uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+//Objects are placed on a grid starting from the bottom of the screen, inside a margin of 5% of the
+//video size like real subtitles, return false if they do not fit
+bool objectPosition(const t_generatorOptions& options, int idx, uint16_t& x, uint16_t& y) {
+    size_t marginX = options.videoWidth / 20;
+    size_t marginY = options.videoHeight / 20;
+    size_t columns = (options.videoWidth - 2 * marginX) / options.objectWidth;
+    size_t rows = (options.videoHeight - 2 * marginY) / options.objectHeight;
+    if (columns == 0 || (size_t)idx >= columns * rows) {
+        return false;
+    }
+
+    size_t usedColumns = std::min(columns, (size_t)options.objects);
+    x = (uint16_t)((options.videoWidth - usedColumns * options.objectWidth) / 2 + (idx % columns) * options.objectWidth);
+    y = (uint16_t)(options.videoHeight - marginY - (idx / columns + 1) * options.objectHeight);
+    return true;
+}
+
+//Text-like bitmap: lines of glyphs made of short runs of the palette colors
+void generateBitmap(t_bitmap& bitmap, uint16_t width, uint16_t height, uint8_t palettes, uint32_t& state) {
+    bitmap.resize(width, height);
+    size_t margin = height / 8;
+
+    for (size_t y = margin; y + margin < height; y++) {
+        uint8_t* line = &bitmap.pixels[y * width];
+        size_t x = margin;
+        while (x + margin < width) {
+            uint32_t random = nextRandom(state);
+            size_t length = std::min((size_t)(1 + random % 12), width - margin - x);
+            if ((random >> 8) % 3 != 0 && palettes > 1) {
+                std::memset(&line[x], 1 + (random >> 16) % (palettes - 1), length);
+            }
+            x += length;
+        }
+    }
+}
+
+void appendSegment(std::vector<uint8_t>& out, uint32_t pts, uint8_t type, size_t size) {
+    t_header header = { 0x5047, pts, pts >= 900 ? pts - 900 : 0, type, (uint16_t)size };
+    size_t start = out.size();
+    out.resize(start + HEADER_SIZE + size);
+    header.write(&out[start]);
+}
+
+bool generateStream(const t_generatorOptions& options, FILE* file, t_streamInfo& info) {
+    if (options.objects == 0 || options.objects > 64 || options.palettes == 0
+        || options.objectWidth == 0 || options.objectHeight == 0 || options.epoch == 0) {
+        std::fprintf(stderr, "Invalid generator options!\n");
+        return false;
+    }
+
+    uint32_t state = options.seed != 0 ? options.seed : 1;
+    t_PCS pcs = {};
+    t_WDS wds = {};
+    t_PDS pds = {};
+    std::vector<t_bitmap> bitmaps(options.objects);
+    std::vector<std::vector<uint8_t>> data(options.objects);
+
+    pcs.width     = options.videoWidth;
+    pcs.height    = options.videoHeight;
+    pcs.frameRate = 0x10;
+    wds.numberOfWindows = options.objects;
+
+    for (int i = 0; i < options.objects; i++) {
+        uint16_t x, y;
+        if (!objectPosition(options, i, x, y)) {
+            std::fprintf(stderr, "%u objects of %ux%u do not fit the video!\n", options.objects, options.objectWidth, options.objectHeight);
+            return false;
+        }
+
+        t_compositionObject& object = pcs.compositionObjects[i];
+        object.objectID             = (uint16_t)i;
+        object.windowID             = (uint8_t)i;
+        object.horizontalPosition   = x;
+        object.verticalPosition     = y;
+        object.croppedAndForcedFlag = (options.cropped ? e_objectFlags::cropped : 0) | (options.forced ? e_objectFlags::forced : 0);
+        if (options.cropped) {
+            object.croppedHorizontalPosition = options.objectWidth / 4;
+            object.croppedVerticalPosition   = options.objectHeight / 4;
+            object.croppedWidth              = options.objectWidth / 2;
+            object.croppedHeight             = options.objectHeight / 2;
+        }
+
+        wds.windows[i] = { (uint8_t)i, x, y, options.objectWidth, options.objectHeight };
+
+        generateBitmap(bitmaps[i], options.objectWidth, options.objectHeight, options.palettes, state);
+        encodeRLE(bitmaps[i], data[i]);
+    }
+
+    pds.numberOfPalettes = options.palettes;
+    for (int i = 0; i < options.palettes; i++) {
+        uint32_t random = nextRandom(state);
+        pds.palettes[i] = { (uint8_t)i, (uint8_t)(16 + random % 220), (uint8_t)(random >> 8), (uint8_t)(random >> 16), (uint8_t)(i == 0 ? 0 : 255) };
+    }
+
+    std::vector<uint8_t> out;
+    for (size_t i = 0; i < options.events; i++) {
+        uint32_t pts = (uint32_t)(90000 + (uint64_t)i * options.interval * 90);
+        bool epochStart = i % options.epoch == 0;
+        out.clear();
+
+        pcs.compositionNumber = (uint16_t)(i * 2);
+        pcs.compositionState  = epochStart ? e_compositionState::epochStart : e_compositionState::acquisitionPoint;
+        pcs.numberOfCompositionObjects = options.objects;
+        appendSegment(out, pts, e_segmentType::pcs, pcsSize(pcs));
+        pcs.write(&out[out.size() - pcsSize(pcs)]);
+        appendSegment(out, pts, e_segmentType::wds, wdsSize(wds));
+        wds.write(&out[out.size() - wdsSize(wds)]);
+
+        pds.versionNumber = (uint8_t)(i % options.epoch);
+        appendSegment(out, pts, e_segmentType::pds, pdsSize(pds));
+        pds.write(&out[out.size() - pdsSize(pds)]);
+
+        t_header odsHeader = { 0x5047, pts, pts >= 900 ? pts - 900 : 0, e_segmentType::ods, 0 };
+        for (int j = 0; j < options.objects; j++) {
+            t_ODS ods = {};
+            ods.id            = (uint16_t)j;
+            ods.versionNumber = (uint8_t)(i % options.epoch);
+            writeObjectSegments(odsHeader, ods, bitmaps[j], data[j], out);
+        }
+        appendSegment(out, pts, e_segmentType::end, 0);
+
+        uint32_t clearPTS = pts + options.duration * 90;
+        pcs.compositionNumber = (uint16_t)(i * 2 + 1);
+        pcs.compositionState  = e_compositionState::normal;
+        pcs.numberOfCompositionObjects = 0;
+        appendSegment(out, clearPTS, e_segmentType::pcs, pcsSize(pcs));
+        pcs.write(&out[out.size() - pcsSize(pcs)]);
+        appendSegment(out, clearPTS, e_segmentType::wds, wdsSize(wds));
+        wds.write(&out[out.size() - wdsSize(wds)]);
+        appendSegment(out, clearPTS, e_segmentType::end, 0);
+
+        for (size_t pos = 0; pos < out.size(); pos += HEADER_SIZE + t_header::read(&out[pos]).dataLength) {
+            info.segments++;
+        }
+        info.displaySets += 2;
+        info.bytes += out.size();
+        if (std::fwrite(out.data(), 1, out.size(), file) != out.size()) {
+            std::fprintf(stderr, "Unable to write output file!\n");
+            return false;
+        }
+    }
+
+    return true;
+}
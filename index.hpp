@@ -0,0 +1,219 @@
+//Display set index: one entry per display set with its position and the PCS informations, it can be
+//saved next to the input file ("<input>.idx") and is reused as long as size and modification time
+//of the input file match. It is used to only read the part of the stream that is actually needed.
+
+struct t_indexEntry {
+    uint64_t offset; //offset of the display set inside the input file
+    uint32_t size;
+    uint32_t pts;    //PTS of the PCS
+    uint16_t compositionNumber;
+    uint16_t segmentCount;
+    uint8_t  compositionState;
+    uint8_t  pcsCount;
+    uint8_t  reserved[2];
+};
+
+enum e_indexFlags : uint32_t {
+    sortedPTS = 0x01, //PTS never decrease
+    singlePCS = 0x02  //every display set has exactly one PCS
+};
+
+struct t_indexHeader {
+    char     magic[4];
+    uint32_t version;
+    uint64_t fileSize;
+    int64_t  fileTime;
+    uint64_t numberOfEntries;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+char const INDEX_MAGIC[4] = { 'S', 'M', 'I', 'X' };
+uint32_t const INDEX_VERSION = 1;
+
+struct t_index {
+    t_indexHeader header = {};
+    std::vector<t_indexEntry> entries;
+
+    bool build(t_supReader reader);
+    bool load(const std::string& path);
+    bool save(const std::string& path);
+    bool open(const t_cmd& cmd, t_supReader& reader);
+
+    size_t lowerBound(uint32_t pts, const t_cmd& cmd);
+    void cutMergeRange(const t_cmd& cmd, size_t& first, size_t& last);
+};
+
+bool getFileInfo(const char* path, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    size = (uint64_t)std::filesystem::file_size(path, error);
+    if (error) {
+        return false;
+    }
+    time = (int64_t)std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+    return !error;
+}
+
+//Build the index walking the whole stream. The reader is a copy, but when the input is not mapped it
+//shares the FILE* of the caller, which must seek back before reading.
+bool t_index::build(t_supReader reader) {
+    entries.clear();
+    header.flags = e_indexFlags::sortedPTS | e_indexFlags::singlePCS;
+    reader.rewind();
+
+    t_displaySet ds = {};
+    while (reader.read(ds)) {
+        t_indexEntry entry = {};
+        entry.offset       = ds.offset;
+        entry.size         = (uint32_t)(reader.position - ds.offset);
+        entry.segmentCount = (uint16_t)ds.segments.size();
+        entry.pts          = ds.segments[0].header.pts;
+
+        for (t_segment& segment : ds.segments) {
+            if (segment.header.segmentType != e_segmentType::pcs) continue;
+
+            if (entry.pcsCount == 0) {
+                t_PCS pcs = t_PCS::read(ds.body(segment));
+                entry.pts               = segment.header.pts;
+                entry.compositionNumber = pcs.compositionNumber;
+                entry.compositionState  = pcs.compositionState;
+            }
+            entry.pcsCount++;
+        }
+
+        if (entry.pcsCount != 1) {
+            header.flags &= ~e_indexFlags::singlePCS;
+        }
+        if (!entries.empty() && entry.pts < entries.back().pts) {
+            header.flags &= ~e_indexFlags::sortedPTS;
+        }
+        entries.push_back(entry);
+    }
+    if (reader.error) {
+        return false;
+    }
+
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.numberOfEntries = entries.size();
+
+    return true;
+}
+
+//The index is saved in native byte order, it is a cache of the local file and not meant to be shared
+bool t_index::load(const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    t_indexHeader fileHeader = {};
+    bool valid = std::fread(&fileHeader, sizeof(fileHeader), 1, file) == 1
+              && std::memcmp(fileHeader.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0
+              && fileHeader.version == INDEX_VERSION
+              && fileHeader.fileSize == header.fileSize
+              && fileHeader.fileTime == header.fileTime;
+
+    if (valid) {
+        entries.resize(fileHeader.numberOfEntries);
+        valid = entries.empty()
+             || std::fread(entries.data(), sizeof(t_indexEntry), entries.size(), file) == entries.size();
+    }
+    std::fclose(file);
+
+    if (!valid) {
+        entries.clear();
+        return false;
+    }
+    header = fileHeader;
+
+    return true;
+}
+
+bool t_index::save(const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1
+                && (entries.empty() || std::fwrite(entries.data(), sizeof(t_indexEntry), entries.size(), file) == entries.size());
+
+    return std::fclose(file) == 0 && written;
+}
+
+//Load the saved index of the input file if still valid, otherwise build it and save it
+bool t_index::open(const t_cmd& cmd, t_supReader& reader) {
+    std::string path = std::string(cmd.inputFile) + ".idx";
+
+    if (!getFileInfo(cmd.inputFile, header.fileSize, header.fileTime)) {
+        return false;
+    }
+    if (load(path)) {
+        return true;
+    }
+
+    if (!build(reader)) {
+        return false;
+    }
+    if (!save(path)) {
+        std::fprintf(stderr, "Unable to save index file %s\n", path.c_str());
+    }
+
+    return true;
+}
+
+//Same timing correction applied by t_processor::processSegment
+uint32_t retimePTS(uint32_t pts, const t_cmd& cmd) {
+    if (cmd.resync != 1) {
+        pts = (uint32_t)std::round((double)pts * cmd.resync);
+    }
+    if (cmd.delay < 0 && pts < (uint32_t)abs(cmd.delay)) {
+        return 0;
+    }
+
+    return pts + cmd.delay;
+}
+
+//First display set whose corrected PTS is not lower than pts
+size_t t_index::lowerBound(uint32_t pts, const t_cmd& cmd) {
+    auto found = std::partition_point(entries.begin(), entries.end(), [&](const t_indexEntry& entry) {
+        return retimePTS(entry.pts, cmd) < pts;
+    });
+
+    return found - entries.begin();
+}
+
+//Range [first, last) of display sets that can be inside a Cut&Merge section, the display sets are
+//paired (the first one shows the subtitle and the second one clears it) so the range starts at a pair
+void t_index::cutMergeRange(const t_cmd& cmd, size_t& first, size_t& last) {
+    first = 0;
+    last = entries.size();
+
+    bool usable = (header.flags & e_indexFlags::sortedPTS)
+               && (header.flags & e_indexFlags::singlePCS)
+               && !cmd.trace
+               && !cmd.cutMerge.section.empty();
+    if (!usable) {
+        return;
+    }
+
+    uint32_t sectionsBegin = cmd.cutMerge.section[0].begin;
+    uint32_t sectionsEnd = 0;
+    for (const t_cutMergeSection& section : cmd.cutMerge.section) {
+        sectionsEnd = std::max(sectionsEnd, section.end);
+    }
+
+    //With --add_zero the display set with composition number 0 must be processed
+    if (!cmd.addZero) {
+        first = lowerBound(sectionsBegin, cmd);
+        first -= first % 2;
+    }
+
+    if (sectionsEnd < UINT32_MAX) {
+        last = lowerBound(sectionsEnd + 1, cmd);
+        last += last % 2;
+        last = std::min(last, entries.size());
+    }
+}
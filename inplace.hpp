@@ -0,0 +1,389 @@
+//In-place mode: the options that never change the size of a segment (delay, resync, move, tonemap and
+//crop when no object is re-encoded) write back to the input file only the bytes they modify, the
+//segment headers and the PCS, WDS and PDS bodies. The ODS bodies, the bulk of the file, are never
+//written.
+//
+//The original bytes are saved in the journal "<input>.journal" before being overwritten, in batches
+//made durable with fsync before the writes of the batch. The journal is removed once the modified
+//file is synced, a journal left by an interrupted job is replayed before any later job reads the
+//file, so supmover sees either the original or the fully modified one.
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SUPMOVER_INPLACE
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef SUPMOVER_INPLACE
+char const JOURNAL_MAGIC[4] = { 'S', 'M', 'J', 'N' };
+uint32_t const JOURNAL_VERSION = 1;
+size_t const INPLACE_BATCH_SIZE = 1024 * 1024; //original bytes saved in the journal before each sync
+
+struct t_journalHeader {
+    char     magic[4];
+    uint32_t version;
+    uint64_t fileSize; //the journal is only replayed on a file of the same size
+};
+
+//Followed by length original bytes
+struct t_journalRecord {
+    uint64_t offset;
+    uint64_t length;
+};
+
+struct t_patchWrite {
+    uint64_t offset;
+    size_t   start;  //position of the new bytes in t_inPlacePatch::bytes
+    size_t   length;
+};
+
+struct t_inPlacePatch {
+    int   fd = -1;
+    FILE* journal = nullptr;
+    std::string journalPath;
+    std::vector<uint8_t> undo;  //journal records of the pending writes
+    std::vector<uint8_t> bytes; //new bytes of the pending writes
+    std::vector<t_patchWrite> writes;
+    size_t lastRecord = 0;      //position in undo of the record of writes.back()
+    uint64_t fileSize = 0;
+    size_t patchedBytes = 0;
+
+    bool open(uint64_t fileSize);
+    void add(uint64_t offset, const uint8_t* original, const uint8_t* modified, size_t length);
+    bool addDisplaySet(const t_displaySet& ds, const std::vector<uint8_t>& original, const std::vector<t_segment>& originalSegments);
+    bool flush();
+    bool commit();
+    void rollback();
+};
+
+bool writeAt(int fd, const uint8_t* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, (off_t)offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+
+    return true;
+}
+
+//The new directory entry of the journal must survive a crash too
+bool syncDirectory(const std::string& path) {
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    close(fd);
+
+    return synced;
+}
+
+//Put back the original bytes saved in the journal at path, if there is one. A record cut short was
+//being written when the job stopped, its bytes were not overwritten yet.
+bool restoreJournal(const std::string& path, int fd, uint64_t fileSize) {
+    FILE* journal = std::fopen(path.c_str(), "rb");
+    if (journal == nullptr) {
+        return true;
+    }
+
+    t_journalHeader header = {};
+    if (std::fread(&header, sizeof(header), 1, journal) == 1
+        && (std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0
+            || header.version != JOURNAL_VERSION || header.fileSize != fileSize)) {
+        std::fprintf(stderr, "Journal %s does not belong to the input file, remove it to continue!\n", path.c_str());
+        std::fclose(journal);
+        return false;
+    }
+
+    bool restored = true;
+    size_t records = 0;
+    t_journalRecord record;
+    std::vector<uint8_t> original;
+    while (restored && std::fread(&record, sizeof(record), 1, journal) == 1) {
+        if (record.length > fileSize || record.offset > fileSize - record.length) {
+            break;
+        }
+        original.resize((size_t)record.length);
+        if (std::fread(original.data(), 1, original.size(), journal) != original.size()) {
+            break;
+        }
+        restored = writeAt(fd, original.data(), original.size(), record.offset);
+        records++;
+    }
+    std::fclose(journal);
+
+    if (!restored || fsync(fd) != 0) {
+        std::fprintf(stderr, "Unable to restore the input file from journal %s!\n", path.c_str());
+        return false;
+    }
+    std::remove(path.c_str());
+    if (records != 0) {
+        std::fprintf(stderr, "Restored the input file from journal %s, %zu writes undone\n", path.c_str(), records);
+    }
+
+    return true;
+}
+
+bool t_inPlacePatch::open(uint64_t fileSize) {
+    this->fileSize = fileSize;
+    journal = std::fopen(journalPath.c_str(), "wb");
+    if (journal == nullptr) {
+        std::fprintf(stderr, "Unable to create journal %s!\n", journalPath.c_str());
+        return false;
+    }
+
+    t_journalHeader header = {};
+    std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header.version = JOURNAL_VERSION;
+    header.fileSize = fileSize;
+    if (std::fwrite(&header, sizeof(header), 1, journal) != 1 || std::fflush(journal) != 0
+        || fsync(fileno(journal)) != 0 || !syncDirectory(journalPath)) {
+        std::fprintf(stderr, "Unable to write journal %s!\n", journalPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+//Bytes following the previous write extend it, a header is often followed by its modified body
+void t_inPlacePatch::add(uint64_t offset, const uint8_t* original, const uint8_t* modified, size_t length) {
+    if (!writes.empty() && writes.back().offset + writes.back().length == offset) {
+        writes.back().length += length;
+        t_journalRecord record = { writes.back().offset, writes.back().length };
+        std::memcpy(&undo[lastRecord], &record, sizeof(record));
+    }
+    else {
+        writes.push_back({ offset, bytes.size(), length });
+        t_journalRecord record = { offset, length };
+        lastRecord = undo.size();
+        undo.insert(undo.end(), (const uint8_t*)&record, (const uint8_t*)&record + sizeof(record));
+    }
+    undo.insert(undo.end(), original, original + length);
+    bytes.insert(bytes.end(), modified, modified + length);
+}
+
+//Queue the bytes of ds changed by the processing, false if its layout changed and the file would
+//have to be rewritten
+bool t_inPlacePatch::addDisplaySet(const t_displaySet& ds, const std::vector<uint8_t>& original, const std::vector<t_segment>& originalSegments) {
+    if (ds.segments.size() != originalSegments.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < ds.segments.size(); i++) {
+        const t_segment& segment = ds.segments[i];
+        const t_segment& before  = originalSegments[i];
+        const uint8_t* modified = &ds.buffer[segment.start];
+        const uint8_t* saved    = &original[before.start];
+
+        //Type and length are the last 3 bytes of the header
+        if (segment.offset != before.offset || segment.data != before.data
+            || std::memcmp(&modified[HEADER_SIZE - 3], &saved[HEADER_SIZE - 3], 3) != 0) {
+            return false;
+        }
+        if (std::memcmp(modified, saved, HEADER_SIZE) != 0) {
+            add(segment.offset, saved, modified, HEADER_SIZE);
+        }
+
+        //The mapped bodies are never modified, the copied ones are compared
+        if (segment.data != nullptr || before.header.dataLength == 0
+            || std::memcmp(&modified[HEADER_SIZE], &saved[HEADER_SIZE], before.header.dataLength) == 0) {
+            continue;
+        }
+        if (before.header.segmentType == e_segmentType::ods) {
+            return false;
+        }
+        add(segment.offset + HEADER_SIZE, &saved[HEADER_SIZE], &modified[HEADER_SIZE], before.header.dataLength);
+    }
+
+    return true;
+}
+
+//The original bytes reach the disk before they are overwritten
+bool t_inPlacePatch::flush() {
+    if (writes.empty()) {
+        return true;
+    }
+    if (std::fwrite(undo.data(), undo.size(), 1, journal) != 1 || std::fflush(journal) != 0 || fsync(fileno(journal)) != 0) {
+        return false;
+    }
+
+    for (const t_patchWrite& write : writes) {
+        if (!writeAt(fd, &bytes[write.start], write.length, write.offset)) {
+            return false;
+        }
+        patchedBytes += write.length;
+    }
+    undo.clear();
+    bytes.clear();
+    writes.clear();
+
+    return true;
+}
+
+//Once the modified file is synced the journal is no longer needed
+bool t_inPlacePatch::commit() {
+    if (!flush() || fsync(fd) != 0) {
+        return false;
+    }
+    std::fclose(journal);
+    journal = nullptr;
+    std::remove(journalPath.c_str());
+
+    return true;
+}
+
+void t_inPlacePatch::rollback() {
+    if (journal != nullptr) {
+        std::fclose(journal);
+        journal = nullptr;
+    }
+    restoreJournal(journalPath, fd, fileSize);
+}
+
+//A journal left by an interrupted job is replayed before the input file is read by any job, in place
+//or not. An in-place job holds an exclusive lock on its input until its journal is removed, a job on
+//a locked input is refused instead, so a journal still in use is never replayed. The file is only
+//opened for writing when there is a journal.
+bool replayJournal(const char* inputFile) {
+    std::string journalPath = std::string(inputFile) + ".journal";
+    std::error_code error;
+    bool journal = std::filesystem::exists(journalPath, error);
+
+    int fd = ::open(inputFile, journal ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        if (!journal) {
+            return true; //the error is reported when the input is opened
+        }
+        std::fprintf(stderr, "Unable to open input file %s for writing to replay journal %s!\n", inputFile, journalPath.c_str());
+        return false;
+    }
+    if (flock(fd, (journal ? LOCK_EX : LOCK_SH) | LOCK_NB) != 0) {
+        std::fprintf(stderr, "Input file %s is being modified in place by another job!\n", inputFile);
+        close(fd);
+        return false;
+    }
+
+    struct stat info;
+    bool restored = !journal || (fstat(fd, &info) == 0 && restoreJournal(journalPath, fd, (uint64_t)info.st_size));
+    close(fd);
+
+    return restored;
+}
+
+//The options of cmd must keep the size of every display set, checked before opening the input
+bool prepareInPlace(const t_cmd& cmd) {
+    if (cmd.outputFile != nullptr) {
+        std::fprintf(stderr, "In-place mode modifies the input file, no output file can be given!\n");
+        return false;
+    }
+    if (cmd.cutMerge.doCutMerge || cmd.addZero || cmd.recover) {
+        std::fprintf(stderr, "Cut&Merge, add_zero and recover change the size of the file, they cannot be used in place!\n");
+        return false;
+    }
+
+    return true;
+}
+
+//Process the display sets of reader writing the modified bytes back to the input file. On error the
+//file is restored from the journal.
+bool processInPlace(const t_cmd& cmd, t_processor& processor, t_supReader& reader) {
+    t_inPlacePatch patch = {};
+    patch.journalPath = std::string(cmd.inputFile) + ".journal";
+    patch.fd = ::open(cmd.inputFile, O_RDWR);
+    struct stat info;
+    if (patch.fd < 0 || fstat(patch.fd, &info) != 0) {
+        std::fprintf(stderr, "Unable to open input file %s for writing!\n", cmd.inputFile);
+        if (patch.fd >= 0) {
+            close(patch.fd);
+        }
+        return false;
+    }
+    //The lock is held until the journal is removed, it is released by close
+    if (flock(patch.fd, LOCK_EX | LOCK_NB) != 0) {
+        std::fprintf(stderr, "Input file %s is being modified in place by another job!\n", cmd.inputFile);
+        close(patch.fd);
+        return false;
+    }
+    //A journal left since replayJournal is replayed before patch.open overwrites it
+    if (!restoreJournal(patch.journalPath, patch.fd, (uint64_t)info.st_size)) {
+        close(patch.fd);
+        return false;
+    }
+    if (!patch.open((uint64_t)info.st_size)) {
+        patch.rollback();
+        close(patch.fd);
+        return false;
+    }
+
+    thread_local t_displaySet ds;
+    thread_local std::vector<uint8_t>   original;
+    thread_local std::vector<t_segment> originalSegments;
+    t_stats& stats = processor.stats;
+    bool patched = true;
+
+    stats.enter(phaseRead);
+    while (reader.read(ds)) {
+        original = ds.buffer;
+        originalSegments = ds.segments;
+        stats.enter(phaseProcess);
+        processor.processDisplaySet(ds);
+
+        stats.enter(phaseWrite);
+        if (!patch.addDisplaySet(ds, original, originalSegments)) {
+            std::fprintf(stderr, "The display set at position %zu changes size, the file cannot be modified in place!\n", ds.offset);
+            patched = false;
+            break;
+        }
+        if (patch.undo.size() >= INPLACE_BATCH_SIZE && !patch.flush()) {
+            std::fprintf(stderr, "Unable to write input file!\n");
+            patched = false;
+            break;
+        }
+        stats.enter(phaseRead);
+    }
+
+    stats.enter(phaseWrite);
+    if (patched && !reader.error && !patch.commit()) {
+        std::fprintf(stderr, "Unable to write input file!\n");
+        patched = false;
+    }
+    patched = patched && !reader.error;
+    if (!patched) {
+        patch.rollback();
+    }
+    stats.stop();
+    stats.outputBytes = patched ? patch.patchedBytes : 0;
+    close(patch.fd);
+
+    return patched;
+}
+#else
+//Without in-place mode no journal is written, one copied from elsewhere cannot be replayed
+bool replayJournal(const char* inputFile) {
+    std::string journalPath = std::string(inputFile) + ".journal";
+    std::error_code error;
+    if (std::filesystem::exists(journalPath, error)) {
+        std::fprintf(stderr, "Input file %s has an in-place journal %s that cannot be replayed on this platform!\n", inputFile, journalPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool prepareInPlace(const t_cmd&) {
+    std::fprintf(stderr, "In-place mode is not available on this platform!\n");
+    return false;
+}
+
+bool processInPlace(const t_cmd&, t_processor&, t_supReader&) {
+    return false;
+}
+#endif
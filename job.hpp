@@ -0,0 +1,443 @@
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+//Process the display sets of reader and write them to writer, shared by the command line jobs and
+//the library. Return false on error, the caller releases reader and writer.
+//The display set buffers are kept by each thread, so the workers of batch and server mode reuse them
+//from a job to the next.
+bool processStream(const t_cmd& cmd, t_processor& processor, t_supReader& reader, t_supWriter& writer) {
+    bool doModification = processor.doModification;
+    thread_local t_displaySet ds;
+
+    //Only the display sets that can be inside a Cut&Merge section need to be read
+    size_t beginOffset = 0;
+    if (cmd.index) {
+        t_index index = {};
+        if (!index.open(cmd, reader)) {
+            std::fprintf(stderr, "Unable to index input file!\n");
+            return false;
+        }
+
+        if (cmd.cutMerge.doCutMerge) {
+            size_t first, last;
+            index.cutMergeRange(cmd, first, last);
+
+            if (first < index.entries.size()) {
+                beginOffset = index.entries[first].offset;
+            }
+            else if (!index.entries.empty()) {
+                beginOffset = index.entries.back().offset + index.entries.back().size;
+            }
+            if (last < index.entries.size()) {
+                reader.end = index.entries[last].offset;
+            }
+        }
+        //Building the index reads the file through the same FILE* when it is not mapped
+        reader.seek(beginOffset);
+    }
+
+    t_stats& stats = processor.stats;
+    //The parallel path writes every chunk, the analysis alone is read on a single thread
+    bool parallel = doModification && canProcessParallel(cmd, reader) && processParallel(cmd, reader, writer, stats);
+
+    //Cut&Merge keeps the display sets of the current pair until the one clearing the subtitle
+    //is processed, only then it is known if the pair is inside a section
+    thread_local std::vector<t_displaySet> pending;
+    size_t pendingCount = 0;
+
+    stats.enter(phaseRead);
+    while (!parallel && reader.read(ds)) {
+        stats.enter(phaseProcess);
+        processor.processDisplaySet(ds);
+
+        if (doModification && !cmd.cutMerge.doCutMerge) {
+            stats.enter(phaseWrite);
+            writer.write(ds);
+        }
+
+        if (cmd.cutMerge.doCutMerge) {
+            if (pendingCount == pending.size()) {
+                pending.emplace_back();
+            }
+            std::swap(ds, pending[pendingCount++]);
+
+            if (processor.cutMerge_pairClosed) {
+                if (processor.cutMerge_pairSection != -1) {
+                    stats.enter(phaseCutMerge);
+                    processor.cutMergePair(pending, pendingCount);
+                    stats.enter(phaseWrite);
+                    for (size_t i = 0; i < pendingCount; i++) {
+                        writer.write(pending[i]);
+                    }
+                }
+                pendingCount = 0;
+            }
+        }
+        stats.enter(phaseRead);
+    }
+    stats.stop();
+
+    for (const t_damagedSpan& span : reader.damagedSpans) {
+        stats.damagedSpans++;
+        stats.droppedSegments += span.droppedSegments;
+        std::fprintf(stderr, "Damaged data at position %zd, dropped %zu bytes from position %zd to %zd (%zu segments)\n",
+                     span.damage, span.end - span.begin, span.begin, span.end, span.droppedSegments);
+    }
+
+    if (writer.error) {
+        std::fprintf(stderr, "Unable to write output file!\n");
+    }
+
+    return !reader.error && !writer.error;
+}
+
+//"-" is the standard input or output, for pipelines
+bool isStandardStream(const char* path) {
+    return path != nullptr && std::strcmp(path, "-") == 0;
+}
+
+FILE* openStandardStream(FILE* stream) {
+#ifdef _WIN32
+    _setmode(_fileno(stream), _O_BINARY);
+#endif
+    return stream;
+}
+
+void closeFile(FILE* file) {
+    if (file != stdin && file != stdout) {
+        std::fclose(file);
+    }
+    else if (file == stdout) {
+        std::fflush(file);
+    }
+}
+
+//The output is written as Matroska when its extension is .mks
+void openOutputFormat(t_supWriter& writer, t_mksWriter& mks, const char* outputName) {
+    if (writer.file != nullptr && isMatroskaOutput(outputName)) {
+        writer.callback = writeMks;
+        writer.opaque = &mks;
+        writer.error = !mks.open(writer.file);
+    }
+}
+
+bool closeOutputFormat(t_supWriter& writer, t_mksWriter& mks) {
+    if (writer.callback == writeMks && !mks.close()) {
+        std::fprintf(stderr, "Unable to write output file!\n");
+        return false;
+    }
+    return true;
+}
+
+//PGS track demuxed in memory from a container
+struct t_demuxedTrack {
+    std::string name;   //PID or track number
+    std::string suffix; //added to the output name when more tracks are processed
+    const std::vector<uint8_t>* sup;
+};
+
+//Process the selected tracks, each into its own output. The statistics of the tracks are added to
+//the ones of processor.
+bool processTracks(const t_cmd& cmd, t_processor& processor, const std::vector<t_demuxedTrack>& selected) {
+    if (selected.size() > 1 && isStandardStream(cmd.outputFile)) {
+        std::fprintf(stderr, "Only one PGS track can be written on the standard output!\n");
+        return false;
+    }
+
+    //The index describes the .sup of a file, not the tracks demuxed in memory
+    t_cmd trackCmd = cmd;
+    trackCmd.index = false;
+
+    bool processed = true;
+    for (const t_demuxedTrack& track : selected) {
+        t_processor trackProcessor = {};
+        trackProcessor.init(trackCmd, nullptr);
+        trackProcessor.trace = processor.trace;
+        trackProcessor.doModification = processor.doModification;
+
+        if (selected.size() > 1 && trackProcessor.doTextTrace) {
+            std::printf("+ PGS track %s\n", track.name.c_str());
+        }
+
+        std::string outputName;
+        FILE* output = nullptr;
+        if (processor.doModification) {
+            outputName = selected.size() > 1 ? trackOutputName(cmd.outputFile, track.suffix) : cmd.outputFile;
+            output = isStandardStream(cmd.outputFile) ? openStandardStream(stdout) : std::fopen(outputName.c_str(), "wb");
+            if (output == nullptr) {
+                std::fprintf(stderr, "Unable to open output file %s!\n", outputName.c_str());
+                return false;
+            }
+        }
+
+        t_supReader trackReader = {};
+        trackReader.recover = cmd.recover;
+        trackReader.copyBody = trackProcessor.plan.copyBody;
+        trackReader.setBuffer(track.sup->data(), track.sup->size());
+        t_supWriter writer = {};
+        writer.file = output;
+        writer.flush = isStandardStream(cmd.outputFile);
+        writer.source = &trackReader;
+        trackProcessor.writer = &writer;
+        t_mksWriter mks = {};
+        openOutputFormat(writer, mks, outputName.c_str());
+
+        processed = processStream(trackCmd, trackProcessor, trackReader, writer) && processed;
+        processed = closeOutputFormat(writer, mks) && processed;
+        trackReader.unmapInput();
+
+        if (output != nullptr) {
+            closeFile(output);
+            std::error_code error;
+            if (!isStandardStream(cmd.outputFile)) {
+                processor.stats.outputBytes += (size_t)std::filesystem::file_size(outputName, error);
+            }
+        }
+        processor.stats.merge(trackProcessor.stats);
+    }
+
+    return processed;
+}
+
+//Demux the PGS tracks of a transport stream and process the selected ones
+bool processTransportStream(const t_cmd& cmd, t_processor& processor, t_supReader& reader, size_t packetSize) {
+    t_tsDemuxer demuxer = {};
+    demuxer.init(cmd, packetSize);
+    processor.stats.enter(phaseRead);
+    demuxTransportStream(reader, demuxer);
+    processor.stats.stop();
+
+    if (demuxer.lostSync != 0) {
+        std::fprintf(stderr, "Transport stream out of sync, skipped %zu bytes\n", demuxer.lostSync);
+    }
+    for (t_pgsTrack& track : demuxer.tracks) {
+        if (track.damagedPES != 0) {
+            std::fprintf(stderr, "Dropped %zu damaged PES packets of PID %#06x\n", track.damagedPES, track.pid);
+        }
+    }
+
+    //Without --pid only the first PGS track is processed, every track is processed once even if it is
+    //given more times or also selected by --pid all
+    std::vector<t_pgsTrack*> selected;
+    for (uint16_t pid : cmd.pids) {
+        auto found = std::find_if(demuxer.tracks.begin(), demuxer.tracks.end(), [pid](const t_pgsTrack& track) { return track.pid == pid; });
+        if (found == demuxer.tracks.end()) {
+            std::fprintf(stderr, "PID %#06x not found in the transport stream!\n", pid);
+            return false;
+        }
+        if (std::find(selected.begin(), selected.end(), &*found) == selected.end()) {
+            selected.push_back(&*found);
+        }
+    }
+    if (cmd.allPids) {
+        for (t_pgsTrack& track : demuxer.tracks) {
+            if (std::find(selected.begin(), selected.end(), &track) == selected.end()) {
+                selected.push_back(&track);
+            }
+        }
+    }
+    else if (cmd.pids.empty() && !demuxer.tracks.empty()) {
+        selected.push_back(&demuxer.tracks[0]);
+    }
+    if (selected.empty()) {
+        std::fprintf(stderr, "No PGS track found in the transport stream!\n");
+        return false;
+    }
+
+    std::vector<t_demuxedTrack> tracks;
+    for (t_pgsTrack* track : selected) {
+        char name[8], suffix[8];
+        std::snprintf(name, sizeof(name), "%#06x", track->pid);
+        std::snprintf(suffix, sizeof(suffix), "%04x", track->pid);
+        tracks.push_back({ name, suffix, &track->sup });
+    }
+
+    return processTracks(cmd, processor, tracks);
+}
+
+//Demux the selected PGS tracks of a Matroska file and process them
+bool processMatroska(const t_cmd& cmd, t_processor& processor, t_supReader& reader) {
+    t_mkvDemuxer demuxer = {};
+    demuxer.init(cmd);
+    processor.stats.enter(phaseRead);
+    bool demuxed = demuxMatroska(reader, demuxer);
+    processor.stats.stop();
+
+    if (!demuxed) {
+        std::fprintf(stderr, "Unable to read the Matroska file!\n");
+        return false;
+    }
+    if (demuxer.truncated) {
+        std::fprintf(stderr, "Matroska file truncated, the tracks end at the last complete block\n");
+    }
+    for (t_mkvTrack& track : demuxer.tracks) {
+        if (track.droppedBlocks != 0) {
+            std::fprintf(stderr, "Dropped %zu damaged blocks of track %llu\n", track.droppedBlocks, (unsigned long long)track.number);
+        }
+    }
+
+    for (uint64_t number : cmd.tracks) {
+        auto found = std::find_if(demuxer.tracks.begin(), demuxer.tracks.end(), [number](const t_mkvTrack& track) { return track.number == number; });
+        if (found == demuxer.tracks.end()) {
+            std::fprintf(stderr, "Track %llu is not a PGS track of the Matroska file!\n", (unsigned long long)number);
+            return false;
+        }
+    }
+    if (demuxer.tracks.empty()) {
+        std::fprintf(stderr, "No PGS track found in the Matroska file!\n");
+        return false;
+    }
+
+    std::vector<t_demuxedTrack> tracks;
+    for (t_mkvTrack& track : demuxer.tracks) {
+        tracks.push_back({ std::to_string(track.number), std::to_string(track.number), &track.sup });
+    }
+
+    return processTracks(cmd, processor, tracks);
+}
+
+//Process a single input file as described by cmd, return 0 on success. With report the statistics
+//are stored there instead of being written on stderr. The trace is written on traceOutput, if given,
+//otherwise on the standard output.
+int processFile(const t_cmd& cmd, std::string* report = nullptr, t_traceOutput* traceOutput = nullptr) {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    t_resourceUsage usageBegin = cmd.stats ? getResourceUsage(cmd.sharedProcess) : t_resourceUsage{};
+
+    t_processor processor = {};
+    processor.init(cmd, nullptr);
+
+    bool doModification = processor.doModification;
+    bool doAnalysis = processor.doAnalysis;
+
+    bool inputStream  = isStandardStream(cmd.inputFile);
+    bool outputStream = isStandardStream(cmd.outputFile);
+    if (inputStream && cmd.index) {
+        std::fprintf(stderr, "The index requires an input file, not the standard input!\n");
+        return -1;
+    }
+    if (inputStream && cmd.inPlace) {
+        std::fprintf(stderr, "In-place mode requires an input file, not the standard input!\n");
+        return -1;
+    }
+    if (cmd.inPlace && !prepareInPlace(cmd)) {
+        return -1;
+    }
+    if (!inputStream && !replayJournal(cmd.inputFile)) {
+        return -1;
+    }
+    if (outputStream && doModification && cmd.trace) {
+        std::fprintf(stderr, "The trace cannot be written on the standard output with the output file!\n");
+        return -1;
+    }
+
+    FILE* input = inputStream ? openStandardStream(stdin) : std::fopen(cmd.inputFile, "rb");
+    if (input == nullptr) {
+        std::fprintf(stderr, "Unable to open input file!\n");
+        return -1;
+    }
+    if (doModification && cmd.outputFile == nullptr && !cmd.inPlace) {
+        std::fprintf(stderr, "Specified options require an output file!\n");
+        closeFile(input);
+        return -1;
+    }
+
+    t_traceWriter trace = {};
+    if (cmd.trace && cmd.traceFormat != e_traceFormat::text) {
+        t_traceOutput standardOutput;
+        standardOutput.file = stdout;
+        trace.init(cmd, traceOutput != nullptr ? *traceOutput : standardOutput);
+        processor.trace = &trace;
+    }
+
+    FILE* output = nullptr;
+    if (doModification || doAnalysis) {
+        t_supReader reader = {};
+        reader.file = input;
+        reader.recover = cmd.recover;
+        reader.copyBody = processor.plan.copyBody;
+        reader.mapInput();
+        reader.seekable = reader.map != nullptr || seekFile(input, 0, SEEK_CUR) == 0;
+
+        //Transport streams and Matroska files write their tracks to their own outputs
+        uint8_t probe[TS_PROBE_PACKETS * M2TS_PACKET_SIZE];
+        size_t probeSize = reader.peek(probe, sizeof(probe));
+        size_t packetSize = probeTransportStream(probe, probeSize);
+        bool matroska = probeMatroska(probe, probeSize);
+        bool container = packetSize != 0 || matroska;
+        if (container && (cmd.index || cmd.inPlace)) {
+            std::fprintf(stderr, "The index and in-place mode are not available for transport streams and Matroska files!\n");
+            reader.unmapInput();
+            closeFile(input);
+            return -1;
+        }
+
+        if (doModification && !container && !cmd.inPlace) {
+            output = outputStream ? openStandardStream(stdout) : std::fopen(cmd.outputFile, "wb");
+            if (output == nullptr) {
+                std::fprintf(stderr, "Unable to open output file!\n");
+                reader.unmapInput();
+                closeFile(input);
+                return -1;
+            }
+        }
+        t_supWriter writer = {};
+        writer.file = output;
+        writer.flush = outputStream;
+        writer.source = &reader;
+        processor.writer = &writer;
+        t_mksWriter mks = {};
+        openOutputFormat(writer, mks, cmd.outputFile);
+
+        bool processed = packetSize != 0 ? processTransportStream(cmd, processor, reader, packetSize)
+                       : matroska        ? processMatroska(cmd, processor, reader)
+                       : cmd.inPlace     ? processInPlace(cmd, processor, reader)
+                                         : processStream(cmd, processor, reader, writer);
+        processed = closeOutputFormat(writer, mks) && processed;
+
+        reader.unmapInput();
+        trace.flush();
+        if (trace.error) {
+            std::fprintf(stderr, "Unable to write trace!\n");
+        }
+
+        if (!processed || trace.error) {
+            closeFile(input);
+            if (output != nullptr) {
+                closeFile(output);
+            }
+            return -1;
+        }
+    }
+
+    closeFile(input);
+    if (output != nullptr) {
+        closeFile(output);
+    }
+
+    if (cmd.stats) {
+        t_stats& stats = processor.stats;
+        t_resourceUsage usageEnd = getResourceUsage(cmd.sharedProcess);
+        stats.usage.userSeconds   = usageEnd.userSeconds - usageBegin.userSeconds;
+        stats.usage.systemSeconds = usageEnd.systemSeconds - usageBegin.systemSeconds;
+        stats.usage.cpuTime       = usageBegin.cpuTime && usageEnd.cpuTime;
+        stats.usage.peakMemory    = usageEnd.peakMemory;
+        stats.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        std::error_code error;
+        if (output != nullptr && !outputStream) {
+            stats.outputBytes = (size_t)std::filesystem::file_size(cmd.outputFile, error);
+        }
+
+        if (report != nullptr) {
+            *report = formatStats(cmd, stats);
+        }
+        else {
+            std::string text = formatStats(cmd, stats);
+            std::fwrite(text.data(), 1, text.size(), stderr);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,188 @@
+//libsupmover: the C ABI of supmover.h over the same engine of the command line
+
+#include <iostream>
+#include <cctype>
+#include <cstdarg>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <thread>
+#include <vector>
+#include "pgs.hpp"
+#include "cmd.hpp"
+#include "stream.hpp"
+#include "palette.hpp"
+#include "rle.hpp"
+#include "trace.hpp"
+#include "stats.hpp"
+#include "plan.hpp"
+#include "process.hpp"
+#include "parallel.hpp"
+#include "index.hpp"
+#include "m2ts.hpp"
+#include "mkv.hpp"
+#include "inplace.hpp"
+#include "job.hpp"
+#include "supmover.h"
+
+//Fill cmd as parseCMD would for the same options on the command line, there is no input and output file
+bool optionsToCMD(const supmover_options* options, t_cmd& cmd) {
+    if (options == nullptr) {
+        return false;
+    }
+
+    cmd.delay       = (int32_t)std::round(options->delay_ms * MS_TO_PTS_MULT);
+    cmd.resync      = options->resync;
+    cmd.move.deltaX = options->move_x;
+    cmd.move.deltaY = options->move_y;
+    cmd.crop.left   = options->crop_left;
+    cmd.crop.top    = options->crop_top;
+    cmd.crop.right  = options->crop_right;
+    cmd.crop.bottom = options->crop_bottom;
+    cmd.tonemap     = options->tonemap;
+    cmd.addZero     = options->add_zero != 0;
+    cmd.recover     = options->recover != 0;
+    cmd.threads     = std::max(1u, options->threads);
+
+    if (options->cut_merge_list != nullptr) {
+        if (options->cut_merge_format < e_cutMergeFormat::secut || options->cut_merge_format > e_cutMergeFormat::remap
+            || options->cut_merge_time_mode < e_cutMergeTimeMode::ms || options->cut_merge_time_mode > e_cutMergeTimeMode::timestamp
+            || (options->cut_merge_fix_mode != SUPMOVER_FIXMODE_CUT && options->cut_merge_fix_mode != SUPMOVER_FIXMODE_DELETE)) {
+            return false;
+        }
+
+        cmd.cutMerge.doCutMerge = true;
+        cmd.cutMerge.format     = (e_cutMergeFormat)options->cut_merge_format;
+        cmd.cutMerge.timeMode   = (e_cutMergeTimeMode)options->cut_merge_time_mode;
+        cmd.cutMerge.fixMode    = options->cut_merge_fix_mode == SUPMOVER_FIXMODE_DELETE ? e_cutMergeFixMode::del : e_cutMergeFixMode::cut;
+        cmd.cutMerge.fps        = options->cut_merge_fps;
+        cmd.cutMerge.list       = options->cut_merge_list;
+        toLower(cmd.cutMerge.list);
+
+        if (   cmd.cutMerge.format   == e_cutMergeFormat::vapoursynth
+            && cmd.cutMerge.timeMode == e_cutMergeTimeMode::timestamp) {
+            std::fprintf(stderr, "Compat mode VapourSynth cannot be used alongside timestamp time mode\n");
+            return false;
+        }
+        if (!parseCutMerge(&cmd.cutMerge)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//The output always goes through the writer callback, even when the options do not modify the stream.
+//The input of reader is already set, a buffer or a read callback.
+int processReader(const t_cmd& cmd, t_supReader& reader, t_supWriter& writer) {
+    t_processor processor = {};
+    processor.init(cmd, &writer);
+    processor.doModification = true;
+
+    reader.recover = cmd.recover;
+    reader.copyBody = processor.plan.copyBody;
+    writer.source = &reader;
+
+    bool processed = processStream(cmd, processor, reader, writer);
+    reader.unmapInput();
+
+    return processed ? SUPMOVER_OK : SUPMOVER_ERROR;
+}
+
+struct t_outputBuffer {
+    uint8_t* data;
+    size_t   capacity;
+    size_t   size;
+};
+
+//Once the buffer is full the rest of the output is only counted, to return the required size
+size_t writeOutputBuffer(void* opaque, const uint8_t* data, size_t size) {
+    t_outputBuffer* output = (t_outputBuffer*)opaque;
+    if (output->size < output->capacity) {
+        std::memcpy(&output->data[output->size], data, std::min(size, output->capacity - output->size));
+    }
+    output->size += size;
+
+    return size;
+}
+
+extern "C" {
+
+SUPMOVER_API void supmover_default_options(supmover_options* options) {
+    *options = {};
+    options->resync  = 1;
+    options->tonemap = 1;
+    options->threads = 1;
+    options->cut_merge_format    = SUPMOVER_FORMAT_SECUT;
+    options->cut_merge_time_mode = SUPMOVER_TIMEMODE_MS;
+    options->cut_merge_fix_mode  = SUPMOVER_FIXMODE_CUT;
+}
+
+SUPMOVER_API int supmover_process(const supmover_options* options,
+                                  const uint8_t* input, size_t input_size,
+                                  supmover_write_fn write, void* write_opaque) {
+    t_cmd cmd = {};
+    if (!optionsToCMD(options, cmd) || (input == nullptr && input_size != 0) || write == nullptr) {
+        return SUPMOVER_ERROR;
+    }
+
+    t_supWriter writer = {};
+    writer.callback = write;
+    writer.opaque = write_opaque;
+
+    t_supReader reader = {};
+    reader.setBuffer(input, input_size);
+
+    return processReader(cmd, reader, writer);
+}
+
+SUPMOVER_API int supmover_process_buffer(const supmover_options* options,
+                                         const uint8_t* input, size_t input_size,
+                                         uint8_t* output, size_t output_capacity, size_t* output_size) {
+    t_outputBuffer buffer = { output, output != nullptr ? output_capacity : 0, 0 };
+
+    int result = supmover_process(options, input, input_size, writeOutputBuffer, &buffer);
+    if (output_size != nullptr) {
+        *output_size = buffer.size;
+    }
+    if (result == SUPMOVER_OK && buffer.size > buffer.capacity) {
+        return SUPMOVER_BUFFER_TOO_SMALL;
+    }
+
+    return result;
+}
+
+SUPMOVER_API int supmover_process_callback(const supmover_options* options,
+                                           supmover_read_fn read, void* read_opaque,
+                                           supmover_write_fn write, void* write_opaque) {
+    t_cmd cmd = {};
+    if (!optionsToCMD(options, cmd) || read == nullptr || write == nullptr) {
+        return SUPMOVER_ERROR;
+    }
+
+    t_supWriter writer = {};
+    writer.callback = write;
+    writer.opaque = write_opaque;
+
+    //Read forward as a pipe
+    t_supReader reader = {};
+    reader.callback = read;
+    reader.opaque = read_opaque;
+    reader.seekable = false;
+
+    return processReader(cmd, reader, writer);
+}
+
+}
@@ -0,0 +1,245 @@
+//MPEG transport streams (.ts, and .m2ts with the 4 bytes timestamp of Blu-ray before every packet) are
+//demuxed in a single pass: the PES packets of the PGS tracks are reassembled and their segments are
+//written as .sup segments, taking PTS and DTS from the PES header, in a buffer for each track. The
+//tracks are then processed from their buffers as any .sup input, so no intermediate file is written.
+//The subtitles are a tiny part of the stream, keeping them in memory costs far less than a second pass.
+//The tracks are processed by processTransportStream in job.hpp.
+
+size_t const TS_PACKET_SIZE   = 188;
+size_t const M2TS_PACKET_SIZE = 192;
+size_t const TS_READ_PACKETS  = 4096;
+size_t const TS_PROBE_PACKETS = 5;    //packets starting with a sync byte to recognize a transport stream
+uint8_t const TS_SYNC_BYTE    = 0x47;
+uint16_t const PGS_FIRST_PID  = 0x1200; //PIDs of the PGS tracks on Blu-ray
+uint16_t const PGS_LAST_PID   = 0x121F;
+
+struct t_pgsTrack {
+    uint16_t pid;
+    std::vector<uint8_t> pes;    //PES packet being reassembled
+    bool     inPES = false;
+    uint8_t  continuity = 0xFF;  //continuity counter of the last packet, 0xFF before the first one
+    std::vector<uint8_t> sup;    //segments of the track in .sup format
+    size_t   damagedPES = 0;
+};
+
+struct t_tsDemuxer {
+    size_t packetSize  = TS_PACKET_SIZE;
+    size_t syncOffset  = 0;   //4 on .m2ts, after the timestamp
+    size_t lostSync    = 0;   //bytes skipped to find the next sync byte
+    const t_cmd* cmd   = nullptr;
+    std::vector<t_pgsTrack> tracks;
+    int16_t trackIndex[8192]; //index in tracks of every PID, -1 if not demuxed
+
+    void init(const t_cmd& cmd, size_t packetSize);
+    bool isSelected(uint16_t pid) const;
+    size_t demux(const uint8_t* data, size_t size);
+    void packet(const uint8_t* packet);
+    void finishPES(t_pgsTrack& track);
+    void finish();
+};
+
+//Packet size of the transport stream at the beginning of data, 0 if it is not one. A .sup stream can
+//have sync bytes at the probed positions, its PG magic is checked first.
+size_t probeTransportStream(const uint8_t* data, size_t size) {
+    const size_t sizes[2]   = { TS_PACKET_SIZE, M2TS_PACKET_SIZE };
+    const size_t offsets[2] = { 0, 4 };
+
+    if (size >= 2 && data[0] == 'P' && data[1] == 'G') {
+        return 0;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        //Fewer packets are accepted only if they are the whole input
+        size_t packets = std::min(TS_PROBE_PACKETS, size / sizes[i]);
+        if (packets == 0 || (packets < TS_PROBE_PACKETS && size != packets * sizes[i])) {
+            continue;
+        }
+
+        bool synced = true;
+        for (size_t j = 0; j < packets && synced; j++) {
+            synced = data[j * sizes[i] + offsets[i]] == TS_SYNC_BYTE;
+        }
+        if (synced) {
+            return sizes[i];
+        }
+    }
+
+    return 0;
+}
+
+void t_tsDemuxer::init(const t_cmd& cmd, size_t packetSize) {
+    this->cmd = &cmd;
+    this->packetSize = packetSize;
+    syncOffset = packetSize - TS_PACKET_SIZE;
+    std::fill(trackIndex, trackIndex + 8192, -1);
+}
+
+//Without --pid, or with --pid all, every PGS track of the Blu-ray range is demuxed together with the
+//listed PIDs
+bool t_tsDemuxer::isSelected(uint16_t pid) const {
+    if ((cmd->pids.empty() || cmd->allPids) && pid >= PGS_FIRST_PID && pid <= PGS_LAST_PID) {
+        return true;
+    }
+
+    return std::find(cmd->pids.begin(), cmd->pids.end(), pid) != cmd->pids.end();
+}
+
+//Demux the packets in data, return the bytes consumed: the last partial packet must be given again
+//followed by the rest of the stream
+size_t t_tsDemuxer::demux(const uint8_t* data, size_t size) {
+    size_t pos = 0;
+
+    while (size - pos >= packetSize) {
+        if (data[pos + syncOffset] != TS_SYNC_BYTE) {
+            pos++;
+            lostSync++;
+            continue;
+        }
+        packet(&data[pos + syncOffset]);
+        pos += packetSize;
+    }
+
+    return pos;
+}
+
+void t_tsDemuxer::packet(const uint8_t* packet) {
+    uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+    if (trackIndex[pid] == -1) {
+        if (!isSelected(pid)) {
+            return;
+        }
+        trackIndex[pid] = (int16_t)tracks.size();
+        tracks.emplace_back();
+        tracks.back().pid = pid;
+    }
+    t_pgsTrack& track = tracks[trackIndex[pid]];
+
+    bool errorIndicator = packet[1] & 0x80;
+    bool unitStart      = packet[1] & 0x40;
+    uint8_t adaptation  = (packet[3] >> 4) & 0x03;
+    uint8_t continuity  = packet[3] & 0x0F;
+    if (!(adaptation & 0x01)) {
+        return; //no payload, the continuity counter does not change
+    }
+
+    //A lost packet makes the PES being reassembled unusable, a packet with the same continuity counter of
+    //the previous one is a duplicate and its payload is discarded
+    bool duplicate = !errorIndicator && track.continuity != 0xFF && continuity == track.continuity;
+    bool lost = errorIndicator || (track.continuity != 0xFF && continuity != ((track.continuity + 1) & 0x0F) && !duplicate);
+    track.continuity = continuity;
+    if (lost && track.inPES) {
+        track.damagedPES++;
+        track.inPES = false;
+        track.pes.clear();
+    }
+    if (errorIndicator || duplicate) {
+        return;
+    }
+
+    size_t payload = 4;
+    if (adaptation & 0x02) {
+        payload += 1 + packet[4];
+    }
+    if (payload >= TS_PACKET_SIZE) {
+        return;
+    }
+
+    if (unitStart) {
+        finishPES(track);
+        track.inPES = true;
+    }
+    if (track.inPES) {
+        track.pes.insert(track.pes.end(), packet + payload, packet + TS_PACKET_SIZE);
+    }
+}
+
+//Convert the segments of a complete PES packet, every one gets PTS and DTS of the PES header
+void t_tsDemuxer::finishPES(t_pgsTrack& track) {
+    if (!track.inPES) {
+        return;
+    }
+    track.inPES = false;
+
+    std::vector<uint8_t>& pes = track.pes;
+    if (pes.size() < 9 || pes[0] != 0x00 || pes[1] != 0x00 || pes[2] != 0x01) {
+        track.damagedPES++;
+        pes.clear();
+        return;
+    }
+
+    size_t packetLength = loadBigEndian<uint16_t>(&pes[4]);
+    size_t end = packetLength != 0 ? std::min(pes.size(), 6 + packetLength) : pes.size();
+    uint8_t ptsDtsFlags = pes[7] >> 6;
+    size_t pos = 9 + pes[8];
+
+    //The timestamps are 33 bits, .sup keeps the lower 32
+    auto timestamp = [&pes](size_t at) -> uint32_t {
+        return (uint32_t)((((uint64_t)pes[at] >> 1) & 0x07) << 30 | (uint64_t)pes[at + 1] << 22
+                        | ((uint64_t)pes[at + 2] >> 1) << 15 | (uint64_t)pes[at + 3] << 7 | ((uint64_t)pes[at + 4] >> 1));
+    };
+    t_header header = {};
+    header.header = 0x5047;
+    if ((ptsDtsFlags & 0x02) && pes.size() >= 14) {
+        header.pts = timestamp(9);
+    }
+    if (ptsDtsFlags == 0x03 && pes.size() >= 19) {
+        header.dts = timestamp(14);
+    }
+
+    while (pos + 3 <= end) {
+        header.segmentType = pes[pos];
+        header.dataLength  = loadBigEndian<uint16_t>(&pes[pos + 1]);
+        if (pos + 3 + header.dataLength > end) {
+            track.damagedPES++;
+            break;
+        }
+
+        size_t start = track.sup.size();
+        track.sup.resize(start + HEADER_SIZE);
+        header.write(&track.sup[start]);
+        track.sup.insert(track.sup.end(), &pes[pos + 3], &pes[pos + 3] + header.dataLength);
+        pos += 3 + header.dataLength;
+    }
+
+    pes.clear();
+}
+
+void t_tsDemuxer::finish() {
+    for (t_pgsTrack& track : tracks) {
+        finishPES(track);
+    }
+    std::sort(tracks.begin(), tracks.end(), [](const t_pgsTrack& a, const t_pgsTrack& b) {
+        return a.pid < b.pid;
+    });
+}
+
+//Demux the whole input in a single pass, mapped or read in blocks of packets
+void demuxTransportStream(t_supReader& reader, t_tsDemuxer& demuxer) {
+    if (reader.map != nullptr) {
+        demuxer.demux(reader.map, reader.mapSize);
+    }
+    else {
+        std::vector<uint8_t> buffer(TS_READ_PACKETS * demuxer.packetSize);
+        size_t size = 0;
+        while (true) {
+            size_t bytesRead = reader.readInput(&buffer[size], buffer.size() - size);
+            size += bytesRead;
+            size_t consumed = demuxer.demux(buffer.data(), size);
+            std::memmove(buffer.data(), &buffer[consumed], size - consumed);
+            size -= consumed;
+
+            if (bytesRead == 0) {
+                break;
+            }
+        }
+    }
+
+    demuxer.finish();
+}
+
+//Output of a track when more are processed: "out.sup" becomes "out.1200.sup"
+std::string trackOutputName(const char* outputFile, const std::string& track) {
+    std::filesystem::path path = outputFile;
+
+    return (path.parent_path() / (path.stem().string() + "." + track + path.extension().string())).string();
+}
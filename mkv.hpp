@@ -0,0 +1,1161 @@
+//Matroska (.mkv, .mks) PGS tracks, codec S_HDMV/PGS, are read with a small EBML parser. Every block of
+//a track holds the segments of a display set without "PG", PTS and DTS: the .sup headers are rebuilt
+//with the timestamp of the block as PTS and 0 as DTS, like mkvextract does, in a buffer for each
+//track. The tracks are then processed from their buffers as any .sup input by processMatroska in
+//job.hpp. With Cut&Merge the Cues are used to skip the clusters before the sections, and reading
+//stops after them.
+//The output can be written as a .mks file with a single PGS track by t_mksWriter, at the end.
+
+enum e_ebmlID : uint32_t {
+    idEBML                 = 0x1A45DFA3,
+    idEBMLVersion          = 0x4286,
+    idEBMLReadVersion      = 0x42F7,
+    idEBMLMaxIDLength      = 0x42F2,
+    idEBMLMaxSizeLength    = 0x42F3,
+    idDocType              = 0x4282,
+    idDocTypeVersion       = 0x4287,
+    idDocTypeReadVersion   = 0x4285,
+    idSegment              = 0x18538067,
+    idSeekHead             = 0x114D9B74,
+    idSeek                 = 0x4DBB,
+    idSeekID               = 0x53AB,
+    idSeekPosition         = 0x53AC,
+    idInfo                 = 0x1549A966,
+    idTimestampScale       = 0x2AD7B1,
+    idDuration             = 0x4489,
+    idMuxingApp            = 0x4D80,
+    idWritingApp           = 0x5741,
+    idTracks               = 0x1654AE6B,
+    idTrackEntry           = 0xAE,
+    idTrackNumber          = 0xD7,
+    idTrackUID             = 0x73C5,
+    idTrackType            = 0x83,
+    idFlagLacing           = 0x9C,
+    idLanguage             = 0x22B59C,
+    idCodecID              = 0x86,
+    idContentEncodings     = 0x6D80,
+    idContentEncoding      = 0x6240,
+    idContentEncodingType  = 0x5033,
+    idContentCompression   = 0x5034,
+    idContentCompAlgo      = 0x4254,
+    idContentCompSettings  = 0x4255,
+    idCluster              = 0x1F43B675,
+    idTimestamp            = 0xE7,
+    idBlockGroup           = 0xA0,
+    idBlock                = 0xA1,
+    idBlockDuration        = 0x9B,
+    idSimpleBlock          = 0xA3,
+    idCues                 = 0x1C53BB6B,
+    idCuePoint             = 0xBB,
+    idCueTime              = 0xB3,
+    idCueTrackPositions    = 0xB7,
+    idCueTrack             = 0xF7,
+    idCueClusterPosition   = 0xF1,
+    idCueRelativePosition  = 0xF0
+};
+
+uint64_t const EBML_UNKNOWN_SIZE  = UINT64_MAX;
+uint64_t const MKV_MAX_ELEMENT    = 256 * 1024 * 1024; //larger elements read in memory are skipped
+char const MKV_PGS_CODEC[]        = "S_HDMV/PGS";
+uint8_t const MKV_COMPRESSION_ZLIB   = 0;
+uint8_t const MKV_COMPRESSION_HEADER = 3; //header stripping
+
+//Variable size integer at the beginning of data, return its length or 0 if it is not valid. The IDs
+//keep the marker bit, the sizes with all the bits set are EBML_UNKNOWN_SIZE.
+size_t readVint(const uint8_t* data, size_t size, uint64_t& value, bool keepMarker) {
+    if (size == 0 || data[0] == 0) {
+        return 0;
+    }
+    size_t length = 1;
+    while (!(data[0] & (0x80 >> (length - 1)))) {
+        length++;
+    }
+    if (length > size) {
+        return 0;
+    }
+
+    uint64_t mask = keepMarker ? 0xFF : (0x7F >> (length - 1));
+    value = data[0] & mask;
+    bool allOnes = value == (uint64_t)(0x7F >> (length - 1));
+    for (size_t i = 1; i < length; i++) {
+        value = (value << 8) | data[i];
+        allOnes = allOnes && data[i] == 0xFF;
+    }
+    if (!keepMarker && allOnes) {
+        value = EBML_UNKNOWN_SIZE;
+    }
+
+    return length;
+}
+
+uint64_t readUnsigned(const uint8_t* data, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size && i < 8; i++) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+//Call element(id, data, size) for every child of a master element kept in memory
+template <typename F>
+void forEachElement(const uint8_t* data, size_t size, F element) {
+    size_t pos = 0;
+    while (pos < size) {
+        uint64_t id, length;
+        size_t idLength = readVint(&data[pos], size - pos, id, true);
+        if (idLength == 0 || idLength > 4) {
+            break;
+        }
+        size_t sizeLength = readVint(&data[pos + idLength], size - pos - idLength, length, false);
+        if (sizeLength == 0) {
+            break;
+        }
+        pos += idLength + sizeLength;
+        length = std::min<uint64_t>(length, size - pos);
+
+        element((uint32_t)id, &data[pos], (size_t)length);
+        pos += (size_t)length;
+    }
+}
+
+
+//zlib decoder for the tracks compressed by mkvmerge, which does it by default for PGS. The Huffman
+//codes are decoded a bit at a time, the blocks of a subtitle track are a few kilobytes.
+struct t_huffman {
+    uint16_t count[16];
+    uint16_t symbol[288];
+
+    void build(const uint8_t* lengths, int n);
+};
+
+void t_huffman::build(const uint8_t* lengths, int n) {
+    uint16_t offsets[16];
+    std::fill(count, count + 16, 0);
+    for (int i = 0; i < n; i++) {
+        count[lengths[i]]++;
+    }
+    count[0] = 0;
+    offsets[1] = 0;
+    for (int len = 1; len < 15; len++) {
+        offsets[len + 1] = offsets[len] + count[len];
+    }
+    for (int i = 0; i < n; i++) {
+        if (lengths[i] != 0) {
+            symbol[offsets[lengths[i]]++] = (uint16_t)i;
+        }
+    }
+}
+
+struct t_inflater {
+    const uint8_t* data = nullptr;
+    size_t   size = 0;
+    size_t   pos = 0;
+    uint32_t bitBuffer = 0;
+    int      bitCount = 0;
+    bool     error = false;
+    std::vector<uint8_t>* out = nullptr;
+
+    uint32_t bits(int n);
+    int decode(const t_huffman& huffman);
+    bool stored();
+    bool codes(const t_huffman& lengths, const t_huffman& distances);
+    bool dynamic(t_huffman& lengths, t_huffman& distances);
+    bool inflate();
+};
+
+uint32_t t_inflater::bits(int n) {
+    while (bitCount < n) {
+        if (pos == size) {
+            error = true;
+            return 0;
+        }
+        bitBuffer |= (uint32_t)data[pos++] << bitCount;
+        bitCount += 8;
+    }
+    uint32_t value = bitBuffer & ((1u << n) - 1);
+    bitBuffer >>= n;
+    bitCount -= n;
+
+    return value;
+}
+
+//Canonical Huffman code, -1 if the code is not valid
+int t_inflater::decode(const t_huffman& huffman) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+        code |= (int)bits(1);
+        int count = huffman.count[len];
+        if (code - count < first) {
+            return huffman.symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    error = true;
+
+    return -1;
+}
+
+bool t_inflater::stored() {
+    bitBuffer = 0;
+    bitCount = 0;
+    if (size - pos < 4) {
+        return false;
+    }
+    uint16_t length = data[pos] | (data[pos + 1] << 8);
+    uint16_t check  = data[pos + 2] | (data[pos + 3] << 8);
+    pos += 4;
+    if (length != (uint16_t)~check || size - pos < length) {
+        return false;
+    }
+    out->insert(out->end(), &data[pos], &data[pos] + length);
+    pos += length;
+
+    return true;
+}
+
+bool t_inflater::codes(const t_huffman& lengths, const t_huffman& distances) {
+    static const uint16_t lengthBase[29]  = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t  lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t distanceBase[30]  = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t  distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    while (!error) {
+        int symbol = decode(lengths);
+        if (symbol < 256) {
+            if (symbol < 0) return false;
+            out->push_back((uint8_t)symbol);
+            continue;
+        }
+        if (symbol == 256) {
+            return true;
+        }
+
+        symbol -= 257;
+        if (symbol >= 29) return false;
+        size_t length = lengthBase[symbol] + bits(lengthExtra[symbol]);
+
+        symbol = decode(distances);
+        if (symbol < 0 || symbol >= 30) return false;
+        size_t distance = distanceBase[symbol] + bits(distanceExtra[symbol]);
+        if (distance > out->size()) return false;
+
+        size_t from = out->size() - distance;
+        for (size_t i = 0; i < length; i++) {
+            out->push_back((*out)[from + i]);
+        }
+    }
+
+    return false;
+}
+
+bool t_inflater::dynamic(t_huffman& lengths, t_huffman& distances) {
+    static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    uint8_t codeLengths[320] = {};
+
+    int literalCount  = (int)bits(5) + 257;
+    int distanceCount = (int)bits(5) + 1;
+    int lengthCount   = (int)bits(4) + 4;
+    if (literalCount > 286 || distanceCount > 30) {
+        return false;
+    }
+    for (int i = 0; i < lengthCount; i++) {
+        codeLengths[order[i]] = (uint8_t)bits(3);
+    }
+    lengths.build(codeLengths, 19);
+
+    int n = 0;
+    std::fill(codeLengths, codeLengths + 19, 0);
+    while (n < literalCount + distanceCount && !error) {
+        int symbol = decode(lengths);
+        if (symbol < 0) return false;
+        if (symbol < 16) {
+            codeLengths[n++] = (uint8_t)symbol;
+            continue;
+        }
+
+        uint8_t length = 0;
+        int repeat;
+        if (symbol == 16) {
+            if (n == 0) return false;
+            length = codeLengths[n - 1];
+            repeat = 3 + (int)bits(2);
+        }
+        else if (symbol == 17) {
+            repeat = 3 + (int)bits(3);
+        }
+        else {
+            repeat = 11 + (int)bits(7);
+        }
+        if (n + repeat > literalCount + distanceCount) return false;
+        while (repeat-- > 0) {
+            codeLengths[n++] = length;
+        }
+    }
+
+    lengths.build(codeLengths, literalCount);
+    distances.build(&codeLengths[literalCount], distanceCount);
+
+    return !error && codes(lengths, distances);
+}
+
+bool t_inflater::inflate() {
+    t_huffman lengths, distances;
+    bool last = false;
+
+    while (!last && !error) {
+        last = bits(1);
+        uint32_t type = bits(2);
+        bool decoded;
+
+        if (type == 0) {
+            decoded = stored();
+        }
+        else if (type == 1) {
+            uint8_t fixed[288];
+            std::fill(fixed, fixed + 144, 8);
+            std::fill(fixed + 144, fixed + 256, 9);
+            std::fill(fixed + 256, fixed + 280, 7);
+            std::fill(fixed + 280, fixed + 288, 8);
+            lengths.build(fixed, 288);
+            std::fill(fixed, fixed + 30, 5);
+            distances.build(fixed, 30);
+            decoded = codes(lengths, distances);
+        }
+        else if (type == 2) {
+            decoded = dynamic(lengths, distances);
+        }
+        else {
+            decoded = false;
+        }
+
+        if (!decoded) {
+            return false;
+        }
+    }
+
+    return !error;
+}
+
+//Decompress a zlib stream appending it to out, the checksum is not verified
+bool inflateZlib(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    if (size < 2 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20)) {
+        return false;
+    }
+
+    t_inflater inflater = {};
+    inflater.data = data;
+    inflater.size = size;
+    inflater.pos  = 2;
+    inflater.out  = &out;
+
+    return inflater.inflate();
+}
+
+
+struct t_mkvTrack {
+    uint64_t number;
+    bool     zlib = false;
+    std::vector<uint8_t> strippedHeader; //removed from the beginning of every block by header stripping
+    std::vector<uint8_t> sup;            //segments of the track in .sup format
+    size_t   droppedBlocks = 0;          //laced, encrypted or damaged
+    bool     started  = true;            //false after seeking, until the first display set of a pair
+    bool     finished = false;           //the display sets after the Cut&Merge sections are read
+};
+
+struct t_mkvCue {
+    uint32_t pts;
+    uint64_t clusterPosition; //relative to the data of the segment
+};
+
+//Input of the parser: the mapping, or the file read forward (seeking only if it is not a pipe)
+struct t_mkvInput {
+    t_supReader* reader = nullptr;
+    uint64_t position = 0;
+
+    bool canSeek() const;
+    bool read(uint8_t* data, size_t size);
+    bool skip(uint64_t size);
+    bool seek(uint64_t offset);
+    bool readElement(uint32_t& id, uint64_t& size);
+};
+
+bool t_mkvInput::canSeek() const {
+    return reader->map != nullptr || reader->seekable;
+}
+
+bool t_mkvInput::read(uint8_t* data, size_t size) {
+    if (reader->map != nullptr) {
+        if (position > reader->mapSize || reader->mapSize - position < size) {
+            return false;
+        }
+        std::memcpy(data, &reader->map[position], size);
+    }
+    else if (reader->readInput(data, size) != size) {
+        return false;
+    }
+    position += size;
+
+    return true;
+}
+
+bool t_mkvInput::skip(uint64_t size) {
+    if (canSeek()) {
+        return seek(position + size);
+    }
+
+    uint8_t buffer[4096];
+    while (size > 0) {
+        size_t chunk = (size_t)std::min<uint64_t>(size, sizeof(buffer));
+        if (!read(buffer, chunk)) {
+            return false;
+        }
+        size -= chunk;
+    }
+
+    return true;
+}
+
+bool t_mkvInput::seek(uint64_t offset) {
+    if (reader->map != nullptr) {
+        if (offset > reader->mapSize) {
+            return false;
+        }
+    }
+    else if (!reader->seekable || seekFile(reader->file, (int64_t)offset, SEEK_SET) != 0) {
+        return false;
+    }
+    position = offset;
+
+    return true;
+}
+
+//Read the ID and the size of the next element, false at the end of the input
+bool t_mkvInput::readElement(uint32_t& id, uint64_t& size) {
+    uint8_t data[8];
+    uint64_t value;
+
+    for (int field = 0; field < 2; field++) {
+        if (!read(data, 1) || data[0] == 0) {
+            return false;
+        }
+        size_t length = 1;
+        while (!(data[0] & (0x80 >> (length - 1)))) {
+            length++;
+        }
+        if ((field == 0 && length > 4) || !read(&data[1], length - 1)) {
+            return false;
+        }
+        readVint(data, length, value, field == 0);
+        if (field == 0) {
+            id = (uint32_t)value;
+        }
+        else {
+            size = value;
+        }
+    }
+
+    return true;
+}
+
+struct t_mkvDemuxer {
+    const t_cmd* cmd = nullptr;
+    uint64_t timestampScale = 1000000; //nanoseconds of a tick
+    uint64_t segmentStart = 0;
+    uint64_t cuesPosition = EBML_UNKNOWN_SIZE; //from the SeekHead, relative to segmentStart
+    std::vector<uint8_t> cues;
+    std::vector<t_mkvTrack> tracks;
+    bool     foundTracks = false;
+    bool     truncated = false;
+    int64_t  clusterTimestamp = 0;
+    std::vector<uint8_t> block;
+    std::vector<uint8_t> decoded;
+
+    //Range of the Cut&Merge sections, in PTS after delay and resync
+    bool     limited = false;
+    uint32_t rangeBegin = 0;
+    uint32_t rangeEnd = UINT32_MAX;
+
+    void init(const t_cmd& cmd);
+    bool isSelected(uint64_t number) const;
+    uint32_t toPTS(int64_t ticks) const;
+    void parseSeekHead(const uint8_t* data, size_t size);
+    void parseTracks(const uint8_t* data, size_t size);
+    bool seekToRange(t_mkvInput& input, uint64_t clusterStart);
+    bool finished() const;
+    void parseBlock(const uint8_t* data, size_t size);
+    void appendSegments(t_mkvTrack& track, const uint8_t* data, size_t size, uint32_t pts);
+    bool demux(t_mkvInput& input);
+};
+
+//The file starts with the EBML header
+bool probeMatroska(const uint8_t* data, size_t size) {
+    return size >= 4 && loadBigEndian<uint32_t>(data) == idEBML;
+}
+
+void t_mkvDemuxer::init(const t_cmd& cmd) {
+    this->cmd = &cmd;
+
+    //Like the index, the range starts at a pair and add_zero needs the first display set
+    limited = cmd.cutMerge.doCutMerge && !cmd.trace && !cmd.cutMerge.section.empty();
+    if (limited) {
+        if (!cmd.addZero) {
+            rangeBegin = cmd.cutMerge.section[0].begin;
+        }
+        rangeEnd = 0;
+        for (const t_cutMergeSection& section : cmd.cutMerge.section) {
+            rangeEnd = std::max(rangeEnd, section.end);
+        }
+    }
+}
+
+//Without --track only the first PGS track is demuxed
+bool t_mkvDemuxer::isSelected(uint64_t number) const {
+    if (cmd->allTracks) {
+        return true;
+    }
+    if (cmd->tracks.empty()) {
+        return tracks.empty();
+    }
+
+    return std::find(cmd->tracks.begin(), cmd->tracks.end(), number) != cmd->tracks.end();
+}
+
+//The timestamps are 33 bits like on Blu-ray, .sup keeps the lower 32
+uint32_t t_mkvDemuxer::toPTS(int64_t ticks) const {
+    if (ticks < 0) {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)ticks * timestampScale * 9 + 50000) / 100000);
+}
+
+void t_mkvDemuxer::parseSeekHead(const uint8_t* data, size_t size) {
+    forEachElement(data, size, [this](uint32_t id, const uint8_t* data, size_t size) {
+        if (id != idSeek) return;
+
+        uint64_t seekID = 0, position = EBML_UNKNOWN_SIZE;
+        forEachElement(data, size, [&](uint32_t id, const uint8_t* data, size_t size) {
+            if (id == idSeekID)       seekID = readUnsigned(data, size);
+            if (id == idSeekPosition) position = readUnsigned(data, size);
+        });
+        if (seekID == idCues) {
+            cuesPosition = position;
+        }
+    });
+}
+
+void t_mkvDemuxer::parseTracks(const uint8_t* data, size_t size) {
+    foundTracks = true;
+    forEachElement(data, size, [this](uint32_t id, const uint8_t* data, size_t size) {
+        if (id != idTrackEntry) return;
+
+        t_mkvTrack track = {};
+        std::string codec;
+        bool supported = true;
+        forEachElement(data, size, [&](uint32_t id, const uint8_t* data, size_t size) {
+            if (id == idTrackNumber) track.number = readUnsigned(data, size);
+            if (id == idCodecID)     codec.assign((const char*)data, strnlen((const char*)data, size));
+            if (id != idContentEncodings) return;
+
+            forEachElement(data, size, [&](uint32_t id, const uint8_t* data, size_t size) {
+                if (id != idContentEncoding) return;
+
+                uint64_t type = 0, algorithm = MKV_COMPRESSION_ZLIB;
+                forEachElement(data, size, [&](uint32_t id, const uint8_t* data, size_t size) {
+                    if (id == idContentEncodingType) type = readUnsigned(data, size);
+                    if (id != idContentCompression) return;
+
+                    forEachElement(data, size, [&](uint32_t id, const uint8_t* data, size_t size) {
+                        if (id == idContentCompAlgo)     algorithm = readUnsigned(data, size);
+                        if (id == idContentCompSettings) track.strippedHeader.assign(data, data + size);
+                    });
+                });
+
+                if (type != 0 || (algorithm != MKV_COMPRESSION_ZLIB && algorithm != MKV_COMPRESSION_HEADER)) {
+                    supported = false;
+                }
+                track.zlib = track.zlib || (type == 0 && algorithm == MKV_COMPRESSION_ZLIB);
+                if (algorithm != MKV_COMPRESSION_HEADER) {
+                    track.strippedHeader.clear();
+                }
+            });
+        });
+
+        if (codec != MKV_PGS_CODEC || !isSelected(track.number)) {
+            return;
+        }
+        if (!supported) {
+            std::fprintf(stderr, "Track %llu is encrypted or compressed with an unsupported algorithm, skipped\n", (unsigned long long)track.number);
+            return;
+        }
+        tracks.push_back(std::move(track));
+    });
+}
+
+//At the first cluster, jump to the one with the display sets before the first section. The cue
+//points of the tracks are searched, or all of them if the tracks have none. The second cue before
+//the section is taken, so that a subtitle already on screen at the beginning of the section is read.
+bool t_mkvDemuxer::seekToRange(t_mkvInput& input, uint64_t clusterStart) {
+    if (!limited || rangeBegin == 0 || !input.canSeek()) {
+        return false;
+    }
+
+    uint64_t resume = input.position;
+    if (cues.empty() && cuesPosition != EBML_UNKNOWN_SIZE) {
+        uint32_t id;
+        uint64_t size;
+        if (input.seek(segmentStart + cuesPosition) && input.readElement(id, size) && id == idCues && size <= MKV_MAX_ELEMENT) {
+            cues.resize((size_t)size);
+            if (!input.read(cues.data(), cues.size())) {
+                cues.clear();
+            }
+        }
+    }
+
+    std::vector<t_mkvCue> trackCues, allCues;
+    forEachElement(cues.data(), cues.size(), [&](uint32_t id, const uint8_t* data, size_t size) {
+        if (id != idCuePoint) return;
+
+        uint32_t pts = 0;
+        forEachElement(data, size, [&](uint32_t id, const uint8_t* data, size_t size) {
+            if (id == idCueTime) pts = toPTS((int64_t)readUnsigned(data, size));
+            if (id != idCueTrackPositions) return;
+
+            uint64_t track = 0, position = EBML_UNKNOWN_SIZE;
+            forEachElement(data, size, [&](uint32_t id, const uint8_t* data, size_t size) {
+                if (id == idCueTrack)           track = readUnsigned(data, size);
+                if (id == idCueClusterPosition) position = readUnsigned(data, size);
+            });
+            if (position == EBML_UNKNOWN_SIZE) return;
+
+            bool ofTrack = std::any_of(tracks.begin(), tracks.end(), [track](const t_mkvTrack& t) { return t.number == track; });
+            (ofTrack ? trackCues : allCues).push_back({ pts, position });
+        });
+    });
+
+    std::vector<t_mkvCue>& found = trackCues.empty() ? allCues : trackCues;
+    std::sort(found.begin(), found.end(), [](const t_mkvCue& a, const t_mkvCue& b) {
+        return a.pts < b.pts || (a.pts == b.pts && a.clusterPosition < b.clusterPosition);
+    });
+    auto first = std::partition_point(found.begin(), found.end(), [this](const t_mkvCue& cue) {
+        return retimePTS(cue.pts, *cmd) < rangeBegin;
+    });
+    size_t cue = first - found.begin();
+
+    if (cue >= 2 && segmentStart + found[cue - 2].clusterPosition > clusterStart && input.seek(segmentStart + found[cue - 2].clusterPosition)) {
+        for (t_mkvTrack& track : tracks) {
+            track.started = false;
+        }
+        return true;
+    }
+
+    input.seek(resume);
+    return false;
+}
+
+bool t_mkvDemuxer::finished() const {
+    return limited && !tracks.empty() && std::all_of(tracks.begin(), tracks.end(), [](const t_mkvTrack& track) {
+        return track.finished;
+    });
+}
+
+void t_mkvDemuxer::parseBlock(const uint8_t* data, size_t size) {
+    uint64_t number;
+    size_t length = readVint(data, size, number, false);
+    if (length == 0 || size < length + 3) {
+        return;
+    }
+    auto found = std::find_if(tracks.begin(), tracks.end(), [number](const t_mkvTrack& track) { return track.number == number; });
+    if (found == tracks.end()) {
+        return;
+    }
+    t_mkvTrack& track = *found;
+    if (track.finished) {
+        return;
+    }
+
+    int16_t relative = (int16_t)loadBigEndian<uint16_t>(&data[length]);
+    uint8_t flags = data[length + 2];
+    if (flags & 0x06) {
+        track.droppedBlocks++; //subtitles are never laced
+        return;
+    }
+    data += length + 3;
+    size -= length + 3;
+
+    if (track.zlib) {
+        decoded.clear();
+        if (!inflateZlib(data, size, decoded)) {
+            track.droppedBlocks++;
+            return;
+        }
+        data = decoded.data();
+        size = decoded.size();
+    }
+    else if (!track.strippedHeader.empty()) {
+        decoded.assign(track.strippedHeader.begin(), track.strippedHeader.end());
+        decoded.insert(decoded.end(), data, data + size);
+        data = decoded.data();
+        size = decoded.size();
+    }
+
+    uint32_t pts = toPTS(clusterTimestamp + relative);
+    if (limited) {
+        //After seeking, a display set clearing the subtitle of a pair begun before is skipped
+        if (!track.started) {
+            bool clears = size >= 3 + t_pcsLayout::size && data[0] == e_segmentType::pcs && data[3 + t_pcsLayout::size - 1] == 0;
+            if (clears) {
+                return;
+            }
+            track.started = true;
+        }
+        //The display set after the sections is kept, it can close the last pair
+        track.finished = retimePTS(pts, *cmd) > rangeEnd;
+    }
+
+    appendSegments(track, data, size, pts);
+}
+
+void t_mkvDemuxer::appendSegments(t_mkvTrack& track, const uint8_t* data, size_t size, uint32_t pts) {
+    t_header header = {};
+    header.header = 0x5047;
+    header.pts = pts;
+
+    size_t pos = 0;
+    while (pos + 3 <= size) {
+        header.segmentType = data[pos];
+        header.dataLength  = loadBigEndian<uint16_t>(&data[pos + 1]);
+        if (pos + 3 + header.dataLength > size) {
+            track.droppedBlocks++;
+            break;
+        }
+
+        size_t start = track.sup.size();
+        track.sup.resize(start + HEADER_SIZE);
+        header.write(&track.sup[start]);
+        track.sup.insert(track.sup.end(), &data[pos + 3], &data[pos + 3] + header.dataLength);
+        pos += 3 + header.dataLength;
+    }
+}
+
+//Walk the segment in a single pass. Segment, Cluster and BlockGroup are entered instead of being
+//skipped, their children have IDs of their own, so the clusters of unknown size are read too.
+bool t_mkvDemuxer::demux(t_mkvInput& input) {
+    uint32_t id;
+    uint64_t size;
+    if (!input.readElement(id, size) || id != idEBML || !input.skip(size)) {
+        return false;
+    }
+    do {
+        if (!input.readElement(id, size)) {
+            return false;
+        }
+    } while (id != idSegment && input.skip(size));
+
+    segmentStart = input.position;
+    uint64_t segmentEnd = size == EBML_UNKNOWN_SIZE ? UINT64_MAX : segmentStart + size;
+    bool foundCluster = false;
+
+    while (input.position < segmentEnd && !finished()) {
+        uint64_t elementStart = input.position;
+        if (!input.readElement(id, size)) {
+            break;
+        }
+
+        switch (id) {
+        case idCluster:
+            if (!foundCluster) {
+                foundCluster = true;
+                if (seekToRange(input, elementStart)) {
+                    continue;
+                }
+            }
+            break;
+        case idBlockGroup:
+            break;
+        case idSeekHead:
+        case idInfo:
+        case idTracks:
+        case idCues:
+        case idTimestamp:
+        case idBlock:
+        case idSimpleBlock:
+            if (size > MKV_MAX_ELEMENT) {
+                if (size == EBML_UNKNOWN_SIZE || !input.skip(size)) {
+                    truncated = true;
+                    return foundTracks;
+                }
+                continue;
+            }
+            block.resize((size_t)size);
+            if (!input.read(block.data(), block.size())) {
+                truncated = true;
+                return foundTracks;
+            }
+
+            if (id == idSeekHead) {
+                parseSeekHead(block.data(), block.size());
+            }
+            else if (id == idInfo) {
+                forEachElement(block.data(), block.size(), [this](uint32_t id, const uint8_t* data, size_t size) {
+                    if (id == idTimestampScale) timestampScale = readUnsigned(data, size);
+                });
+            }
+            else if (id == idTracks) {
+                parseTracks(block.data(), block.size());
+            }
+            else if (id == idCues) {
+                cues.swap(block);
+            }
+            else if (id == idTimestamp) {
+                clusterTimestamp = (int64_t)readUnsigned(block.data(), block.size());
+            }
+            else {
+                parseBlock(block.data(), block.size());
+            }
+            break;
+        default:
+            if (size == EBML_UNKNOWN_SIZE || !input.skip(size)) {
+                truncated = true;
+                return foundTracks;
+            }
+        }
+    }
+
+    return foundTracks;
+}
+
+//Demux the selected PGS tracks of the whole input, mapped or read forward
+bool demuxMatroska(t_supReader& reader, t_mkvDemuxer& demuxer) {
+    t_mkvInput input = {};
+    input.reader = &reader;
+    return demuxer.demux(input);
+}
+
+
+//.mks output: the .sup written by t_supWriter goes through its callback to t_mksWriter, which turns
+//every display set in a block of a single PGS track, lasting until the next display set. The clusters
+//are kept in memory until they are complete, so their size is known and a file is written forward
+//only. When the output is a regular file, segment size, Cues position and duration are written over
+//their placeholders at the end.
+int64_t const MKS_TIMESTAMP_SCALE  = 1000000; //milliseconds
+int64_t const MKS_CLUSTER_DURATION = 30000;   //ms, the block timestamps are 16 bit relative to the cluster
+size_t const MKS_CLUSTER_SIZE      = 4 * 1024 * 1024;
+uint64_t const MKS_TRACK_NUMBER    = 1;
+
+//Only the extension tells the output format, the standard output is always .sup
+bool isMatroskaOutput(const char* path) {
+    if (path == nullptr) {
+        return false;
+    }
+    std::string extension = std::filesystem::path(path).extension().string();
+    toLower(extension);
+
+    return extension == ".mks";
+}
+
+void appendID(std::vector<uint8_t>& out, uint32_t id) {
+    for (int shift = id > 0xFFFFFF ? 24 : id > 0xFFFF ? 16 : id > 0xFF ? 8 : 0; shift >= 0; shift -= 8) {
+        out.push_back((uint8_t)(id >> shift));
+    }
+}
+
+//Shortest size, or 8 bytes to be written again at the end
+void appendSize(std::vector<uint8_t>& out, uint64_t size, size_t length = 0) {
+    if (length == 0) {
+        length = 1;
+        while (length < 8 && size >= (1ull << (7 * length)) - 1) {
+            length++;
+        }
+    }
+    out.push_back((uint8_t)((0x100 >> length) | (length < 8 ? size >> (8 * (length - 1)) : 0)));
+    for (size_t i = 1; i < length; i++) {
+        out.push_back((uint8_t)(size >> (8 * (length - 1 - i))));
+    }
+}
+
+void appendElement(std::vector<uint8_t>& out, uint32_t id, const uint8_t* data, size_t size) {
+    appendID(out, id);
+    appendSize(out, size);
+    out.insert(out.end(), data, data + size);
+}
+
+void appendElement(std::vector<uint8_t>& out, uint32_t id, const std::vector<uint8_t>& data) {
+    appendElement(out, id, data.data(), data.size());
+}
+
+void appendString(std::vector<uint8_t>& out, uint32_t id, const char* value) {
+    appendElement(out, id, (const uint8_t*)value, std::strlen(value));
+}
+
+void appendUnsigned(std::vector<uint8_t>& out, uint32_t id, uint64_t value, size_t length = 0) {
+    uint8_t data[8];
+    if (length == 0) {
+        length = 1;
+        while (length < 8 && (value >> (8 * length)) != 0) {
+            length++;
+        }
+    }
+    for (size_t i = 0; i < length; i++) {
+        data[i] = (uint8_t)(value >> (8 * (length - 1 - i)));
+    }
+    appendElement(out, id, data, length);
+}
+
+struct t_mksCue {
+    int64_t  time;
+    uint64_t clusterPosition;
+    uint64_t relativePosition; //of the block inside the data of the cluster
+};
+
+struct t_mksWriter {
+    FILE* file = nullptr;
+    bool  seekable = false;
+    bool  error = false;
+    int64_t segmentStart = 0;    //file offsets of the data of the segment and of the placeholders
+    int64_t segmentSizeOffset = 0;
+    int64_t cuesSeekOffset = 0;
+    int64_t durationOffset = 0;
+    uint64_t written = 0;        //bytes of the segment data written
+
+    std::vector<uint8_t> input;  //.sup of the display set being received
+    std::vector<uint8_t> block;  //segments of the last display set, without the .sup headers
+    int64_t  blockTime = -1;     //-1 before the first display set
+    std::vector<uint8_t> cluster;
+    int64_t  clusterTime = 0;
+    std::vector<t_mksCue> cues;
+    std::vector<uint8_t> element;
+
+    bool open(FILE* file);
+    size_t receive(const uint8_t* data, size_t size);
+    void displaySet(const uint8_t* data, size_t size);
+    void addBlock(int64_t duration);
+    void writeCluster();
+    void writeBytes(const uint8_t* data, size_t size);
+    void writeAt(int64_t offset, const uint8_t* data, size_t size);
+    bool close();
+};
+
+size_t writeMks(void* opaque, const uint8_t* data, size_t size) {
+    return ((t_mksWriter*)opaque)->receive(data, size);
+}
+
+void t_mksWriter::writeBytes(const uint8_t* data, size_t size) {
+    if (!error && size != 0 && std::fwrite(data, size, 1, file) != 1) {
+        error = true;
+    }
+}
+
+void t_mksWriter::writeAt(int64_t offset, const uint8_t* data, size_t size) {
+    if (seekFile(file, offset, SEEK_SET) != 0) {
+        error = true;
+        return;
+    }
+    writeBytes(data, size);
+}
+
+//Write EBML header, SeekHead, Info and Tracks. A pipe gets a segment of unknown size without SeekHead
+//and duration, the Cues are still written at the end.
+bool t_mksWriter::open(FILE* file) {
+    this->file = file;
+    int64_t start = tellFile(file);
+    seekable = start >= 0 && seekFile(file, start, SEEK_SET) == 0;
+
+    std::vector<uint8_t> header, data;
+    appendUnsigned(data, idEBMLVersion, 1);
+    appendUnsigned(data, idEBMLReadVersion, 1);
+    appendUnsigned(data, idEBMLMaxIDLength, 4);
+    appendUnsigned(data, idEBMLMaxSizeLength, 8);
+    appendString(data, idDocType, "matroska");
+    appendUnsigned(data, idDocTypeVersion, 4);
+    appendUnsigned(data, idDocTypeReadVersion, 2);
+    appendElement(header, idEBML, data);
+
+    appendID(header, idSegment);
+    segmentSizeOffset = start + (int64_t)header.size();
+    appendSize(header, EBML_UNKNOWN_SIZE >> 8, 8);
+    segmentStart = start + (int64_t)header.size();
+
+    std::vector<uint8_t> info, tracks;
+    data.clear();
+    appendUnsigned(data, idTimestampScale, MKS_TIMESTAMP_SCALE);
+    appendString(data, idMuxingApp, "SupMover");
+    appendString(data, idWritingApp, "SupMover");
+    if (seekable) {
+        uint8_t zero[8] = {};
+        appendElement(data, idDuration, zero, 8);
+    }
+    appendElement(info, idInfo, data);
+
+    std::vector<uint8_t> entry;
+    appendUnsigned(entry, idTrackNumber, MKS_TRACK_NUMBER);
+    appendUnsigned(entry, idTrackUID, MKS_TRACK_NUMBER);
+    appendUnsigned(entry, idTrackType, 0x11);
+    appendUnsigned(entry, idFlagLacing, 0);
+    appendString(entry, idLanguage, "und");
+    appendString(entry, idCodecID, MKV_PGS_CODEC);
+    data.clear();
+    appendElement(data, idTrackEntry, entry);
+    appendElement(tracks, idTracks, data);
+
+    //The positions have 8 bytes, so the size of the SeekHead does not depend on them. The Cues are the
+    //last entry and the duration the last child of Info, both written again by close.
+    std::vector<uint8_t> seekHead;
+    for (int pass = 0; pass < 2 && seekable; pass++) {
+        const uint32_t ids[3] = { idInfo, idTracks, idCues };
+        const uint64_t positions[3] = { seekHead.size(), seekHead.size() + info.size(), 0 };
+        data.clear();
+        for (int i = 0; i < 3; i++) {
+            std::vector<uint8_t> seek, seekID;
+            appendID(seekID, ids[i]);
+            appendElement(seek, idSeekID, seekID);
+            appendUnsigned(seek, idSeekPosition, positions[i], 8);
+            appendElement(data, idSeek, seek);
+        }
+        seekHead.clear();
+        appendElement(seekHead, idSeekHead, data);
+    }
+    cuesSeekOffset = segmentStart + (int64_t)seekHead.size() - 8;
+    durationOffset = segmentStart + (int64_t)(seekHead.size() + info.size()) - 8;
+
+    header.insert(header.end(), seekHead.begin(), seekHead.end());
+    header.insert(header.end(), info.begin(), info.end());
+    header.insert(header.end(), tracks.begin(), tracks.end());
+    writeBytes(header.data(), header.size());
+    written = seekHead.size() + info.size() + tracks.size();
+
+    return !error;
+}
+
+//Gather the .sup until the END segment of a display set, the writer passes it in pieces
+size_t t_mksWriter::receive(const uint8_t* data, size_t size) {
+    input.insert(input.end(), data, data + size);
+
+    size_t pos = 0;
+    size_t displaySetStart = 0;
+    while (input.size() - pos >= HEADER_SIZE) {
+        t_header header = t_header::read(&input[pos]);
+        if (input.size() - pos - HEADER_SIZE < header.dataLength) {
+            break;
+        }
+        pos += HEADER_SIZE + header.dataLength;
+
+        if (header.segmentType == e_segmentType::end) {
+            displaySet(&input[displaySetStart], pos - displaySetStart);
+            displaySetStart = pos;
+        }
+    }
+    input.erase(input.begin(), input.begin() + displaySetStart);
+
+    return error ? 0 : size;
+}
+
+//The previous display set lasts until this one, only now its block can be written
+void t_mksWriter::displaySet(const uint8_t* data, size_t size) {
+    int64_t time = (int64_t)std::llround(t_header::read((uint8_t*)data).pts / MS_TO_PTS_MULT);
+    if (blockTime != -1) {
+        addBlock(std::max<int64_t>(time - blockTime, 0));
+    }
+
+    block.clear();
+    size_t pos = 0;
+    while (pos < size) {
+        t_header header = t_header::read((uint8_t*)&data[pos]);
+        block.insert(block.end(), &data[pos + 10], &data[pos] + HEADER_SIZE + header.dataLength);
+        pos += HEADER_SIZE + header.dataLength;
+    }
+    blockTime = time;
+}
+
+void t_mksWriter::addBlock(int64_t duration) {
+    int64_t relative = blockTime - clusterTime;
+    if (cluster.empty() || relative < INT16_MIN || relative > MKS_CLUSTER_DURATION || cluster.size() > MKS_CLUSTER_SIZE) {
+        writeCluster();
+        clusterTime = blockTime;
+        relative = 0;
+        appendUnsigned(cluster, idTimestamp, (uint64_t)clusterTime);
+    }
+    cues.push_back({ blockTime, written, cluster.size() });
+
+    element.clear();
+    appendSize(element, MKS_TRACK_NUMBER);
+    element.push_back((uint8_t)((uint16_t)relative >> 8));
+    element.push_back((uint8_t)relative);
+    element.push_back(0x00);
+    element.insert(element.end(), block.begin(), block.end());
+
+    std::vector<uint8_t> group;
+    appendElement(group, idBlock, element);
+    if (duration > 0) {
+        appendUnsigned(group, idBlockDuration, (uint64_t)duration);
+    }
+    appendElement(cluster, idBlockGroup, group);
+}
+
+void t_mksWriter::writeCluster() {
+    if (cluster.empty()) {
+        return;
+    }
+
+    element.clear();
+    appendID(element, idCluster);
+    appendSize(element, cluster.size());
+    writeBytes(element.data(), element.size());
+    writeBytes(cluster.data(), cluster.size());
+    written += element.size() + cluster.size();
+    cluster.clear();
+}
+
+//Write the last block and the Cues, then the values left as placeholders by open
+bool t_mksWriter::close() {
+    //A display set without END at the end of the stream, its incomplete segment is dropped
+    size_t complete = 0;
+    while (input.size() - complete >= HEADER_SIZE
+           && input.size() - complete - HEADER_SIZE >= t_header::read(&input[complete]).dataLength) {
+        complete += HEADER_SIZE + t_header::read(&input[complete]).dataLength;
+    }
+    if (complete != 0) {
+        displaySet(input.data(), complete);
+    }
+    if (blockTime != -1) {
+        addBlock(0);
+    }
+    writeCluster();
+
+    uint64_t cuesPosition = written;
+    std::vector<uint8_t> points;
+    for (const t_mksCue& cue : cues) {
+        std::vector<uint8_t> positions, point;
+        appendUnsigned(positions, idCueTrack, MKS_TRACK_NUMBER);
+        appendUnsigned(positions, idCueClusterPosition, cue.clusterPosition);
+        appendUnsigned(positions, idCueRelativePosition, cue.relativePosition);
+        appendUnsigned(point, idCueTime, (uint64_t)cue.time);
+        appendElement(point, idCueTrackPositions, positions);
+        appendElement(points, idCuePoint, point);
+    }
+    element.clear();
+    appendElement(element, idCues, points);
+    writeBytes(element.data(), element.size());
+    written += element.size();
+
+    if (seekable && !error) {
+        uint8_t value[8];
+        std::vector<uint8_t> size;
+        appendSize(size, written, 8);
+        writeAt(segmentSizeOffset, size.data(), size.size());
+
+        storeBigEndian<uint64_t>(value, cuesPosition);
+        writeAt(cuesSeekOffset, value, 8);
+
+        double duration = cues.empty() ? 0 : (double)cues.back().time;
+        uint64_t bits;
+        std::memcpy(&bits, &duration, 8);
+        storeBigEndian<uint64_t>(value, bits);
+        writeAt(durationOffset, value, 8);
+
+        seekFile(file, 0, SEEK_END);
+    }
+
+    return !error;
+}
@@ -0,0 +1,85 @@
+//Palette operations are compiled once in a lookup table for each palette channel, chaining more
+//operations only changes the tables so every palette entry always costs one lookup per channel.
+
+enum e_paletteChannel : uint8_t {
+    channelY  = 0,
+    channelCb = 1,
+    channelCr = 2,
+    channelA  = 3
+};
+
+//Offset of each channel inside a palette entry, same layout of t_paletteLayout (Y, Cr, Cb, A)
+size_t const PALETTE_ENTRY_SIZE = t_paletteLayout::size;
+size_t const paletteChannelOffset[4] = { 1, 3, 2, 4 };
+
+struct t_paletteLUT {
+    uint8_t table[4][256];
+    bool    active[4] = {};
+
+    void init();
+    template <typename F> void chain(e_paletteChannel channel, F operation);
+    bool isActive();
+    void apply(uint8_t* buffer, size_t segmentSize);
+};
+
+void t_paletteLUT::init() {
+    for (int channel = 0; channel < 4; channel++) {
+        for (int value = 0; value < 256; value++) {
+            table[channel][value] = (uint8_t)value;
+        }
+        active[channel] = false;
+    }
+}
+
+//Apply operation after the ones already in the table of the channel
+template <typename F>
+void t_paletteLUT::chain(e_paletteChannel channel, F operation) {
+    for (int value = 0; value < 256; value++) {
+        table[channel][value] = operation(table[channel][value]);
+    }
+    active[channel] = true;
+}
+
+bool t_paletteLUT::isActive() {
+    return active[channelY] || active[channelCb] || active[channelCr] || active[channelA];
+}
+
+//Transform in place all the palette entries of a PDS segment body
+void t_paletteLUT::apply(uint8_t* buffer, size_t segmentSize) {
+    if (segmentSize < 2) {
+        return;
+    }
+    size_t numberOfPalettes = (segmentSize - 2) / PALETTE_ENTRY_SIZE;
+    uint8_t* entries = &buffer[2];
+
+    for (int channel = 0; channel < 4; channel++) {
+        if (!active[channel]) continue;
+
+        const uint8_t* lut = table[channel];
+        uint8_t* value = &entries[paletteChannelOffset[channel]];
+        for (size_t i = 0; i < numberOfPalettes; i++) {
+            value[i * PALETTE_ENTRY_SIZE] = lut[value[i * PALETTE_ENTRY_SIZE]];
+        }
+    }
+}
+
+
+uint8_t tonemapY(uint8_t valueY, double factor) {
+    //convert Y from TV level (16-235) to full range
+    double expandedY   = ((((double)valueY - 16.0) * (255.0 / (235.0 - 16.0))) / 255.0);
+    double tonemappedY = expandedY * factor;
+    double clampedY    = std::min(1.0, std::max(tonemappedY, 0.0));
+    double newY        = std::round((clampedY * (235.0 - 16.0)) + 16.0);
+
+    return (uint8_t)newY;
+}
+
+//Compile all the palette operations selected on the command line
+void buildPaletteLUT(const t_cmd& cmd, t_paletteLUT& lut) {
+    lut.init();
+
+    if (cmd.tonemap != 1) {
+        double factor = cmd.tonemap;
+        lut.chain(channelY, [factor](uint8_t value) { return tonemapY(value, factor); });
+    }
+}
@@ -0,0 +1,151 @@
+//Intra-file parallelism: a header-only pre-scan of the mapped input finds the display sets
+//and the epochs, the stream is then split in chunks beginning at an epoch start which are
+//processed by multiple threads and written back in the original order.
+//
+//Only the display set local operations (delay, resync, move, crop, tonemap) can be processed this
+//way, Cut&Merge and --add_zero carry state between display sets and --trace must keep its order.
+
+struct t_chunk {
+    size_t begin; //offset of the first display set of the chunk inside the input file
+    size_t end;
+    std::vector<t_displaySet> displaySets;
+    bool done = false;
+    t_stats stats = {};
+};
+
+size_t const CHUNK_MIN_SIZE = 256 * 1024;
+
+bool canProcessParallel(const t_cmd& cmd, const t_supReader& reader) {
+    return cmd.threads > 1
+        && reader.map != nullptr
+        && !cmd.trace
+        && !cmd.addZero
+        && !cmd.cutMerge.doCutMerge;
+}
+
+//Walk only the segment headers and split the stream at the epoch starts, return false if the
+//stream is not valid so that the sequential path can report the error
+bool scanChunks(const t_supReader& reader, uint32_t threads, std::vector<t_chunk>& chunks) {
+    size_t targetSize = std::max(CHUNK_MIN_SIZE, reader.mapSize / ((size_t)threads * 8));
+    size_t chunkBegin = 0;
+    size_t position = 0;
+
+    while (position < reader.mapSize) {
+        if (reader.mapSize - position < HEADER_SIZE) {
+            return false;
+        }
+
+        t_header header = t_header::read((uint8_t*)&reader.map[position]);
+        if (header.header != 0x5047
+            || !isSegmentType(header.segmentType)
+            || reader.mapSize - position - HEADER_SIZE < header.dataLength) {
+            return false;
+        }
+
+        //compositionState is the 8th byte of the PCS
+        if (header.segmentType == e_segmentType::pcs
+            && header.dataLength > 7
+            && reader.map[position + HEADER_SIZE + 7] == e_compositionState::epochStart
+            && position - chunkBegin >= targetSize) {
+            chunks.push_back({ chunkBegin, position, {}, false, {} });
+            chunkBegin = position;
+        }
+
+        position += HEADER_SIZE + header.dataLength;
+    }
+    chunks.push_back({ chunkBegin, position, {}, false, {} });
+
+    return true;
+}
+
+void processChunk(const t_cmd& cmd, const t_supReader& source, t_chunk& chunk) {
+    t_supReader reader = source;
+    reader.position = chunk.begin;
+    reader.end      = chunk.end;
+
+    t_processor processor = {};
+    processor.init(cmd, nullptr);
+
+    t_displaySet ds = {};
+    processor.stats.enter(phaseRead);
+    while (reader.read(ds)) {
+        processor.stats.enter(phaseProcess);
+        processor.processDisplaySet(ds);
+        chunk.displaySets.push_back(std::move(ds));
+        ds = {};
+        processor.stats.enter(phaseRead);
+    }
+    processor.stats.stop();
+    chunk.stats = processor.stats;
+}
+
+//Return false if the stream could not be split, in that case nothing was written
+//The statistics of the chunks are added to stats, their phase times are summed over the threads
+bool processParallel(const t_cmd& cmd, t_supReader& reader, t_supWriter& writer, t_stats& stats) {
+    std::vector<t_chunk> chunks;
+    if (!scanChunks(reader, cmd.threads, chunks) || chunks.size() < 2) {
+        return false;
+    }
+
+    std::mutex mutex;
+    std::condition_variable chunkDone;
+    std::condition_variable chunkWritten;
+    size_t nextChunk = 0;
+    size_t written = 0;
+    //Limit the chunks processed ahead of the writer, so memory does not grow with the file size
+    size_t const window = (size_t)cmd.threads * 2;
+
+    auto worker = [&]() {
+        while (true) {
+            size_t idx;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                chunkWritten.wait(lock, [&]() { return nextChunk >= chunks.size() || nextChunk < written + window; });
+                if (nextChunk >= chunks.size()) {
+                    return;
+                }
+                idx = nextChunk++;
+            }
+
+            processChunk(cmd, reader, chunks[idx]);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                chunks[idx].done = true;
+            }
+            chunkDone.notify_all();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (uint32_t i = 0; i < std::min((size_t)cmd.threads, chunks.size()); i++) {
+        pool.emplace_back(worker);
+    }
+
+    for (t_chunk& chunk : chunks) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            chunkDone.wait(lock, [&]() { return chunk.done; });
+        }
+
+        stats.enter(phaseWrite);
+        for (t_displaySet& ds : chunk.displaySets) {
+            writer.write(ds);
+        }
+        stats.stop();
+        stats.merge(chunk.stats);
+        chunk.displaySets = {};
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            written++;
+        }
+        chunkWritten.notify_all();
+    }
+
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+
+    return true;
+}
@@ -20,6 +20,34 @@ struct t_header {
 size_t const HEADER_SIZE = 13;
 
 
+//Entries of a segment, their number is stored in the segment. The first N entries, the most allowed
+//by the specification, are stored inline, only streams not following it allocate the others.
+template <typename T, size_t N>
+struct t_segmentList {
+    T items[N];
+    std::vector<T> overflow;
+
+    T& operator[](size_t idx);
+    const T& operator[](size_t idx) const;
+};
+
+template <typename T, size_t N>
+T& t_segmentList<T, N>::operator[](size_t idx) {
+    if (idx < N) {
+        return items[idx];
+    }
+    if (overflow.size() <= idx - N) {
+        overflow.resize(idx - N + 1);
+    }
+    return overflow[idx - N];
+}
+
+template <typename T, size_t N>
+const T& t_segmentList<T, N>::operator[](size_t idx) const {
+    return idx < N ? items[idx] : overflow[idx - N];
+}
+
+
 struct t_window {
     uint8_t  id;
     uint16_t horizontalPosition;
@@ -29,10 +57,11 @@ struct t_window {
 };
 struct t_WDS {
     uint8_t  numberOfWindows;
-    t_window windows[256];
+    t_segmentList<t_window, 2> windows;
 
     static t_WDS read(uint8_t*);
     void write(uint8_t*);
+    void clear();
 };
 
 
@@ -67,10 +96,11 @@ struct t_PCS {
     uint8_t  paletteUpdateFlag;
     uint8_t  paletteID;
     uint8_t  numberOfCompositionObjects;
-    t_compositionObject compositionObjects[256];
+    t_segmentList<t_compositionObject, 2> compositionObjects;
 
     static t_PCS read(uint8_t*);
     void write(uint8_t*);
+    void clear();
 };
 
 
@@ -84,11 +114,12 @@ struct t_palette {
 struct t_PDS {
     uint8_t id;
     uint8_t versionNumber;
-    t_palette palettes[255];
+    t_segmentList<t_palette, 256> palettes;
     uint8_t numberOfPalettes; //not in format, only used internally
 
     static t_PDS read(uint8_t*, size_t);
     void write(uint8_t*);
+    void clear();
 };
 
 
@@ -107,186 +138,337 @@ struct t_ODS {
     //uint8_t* data;
 
     static t_ODS read(uint8_t*);
+    void write(uint8_t*);
+    void writeFragment(uint8_t*);
 };
 
 
-uint16_t swapEndianness(uint16_t input) {
-    uint16_t output;
-
-    output = (input >> 8) | (input << 8);
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
 
-    return output;
+uint16_t swapEndianness(uint16_t input) {
+#ifdef _MSC_VER
+    return _byteswap_ushort(input);
+#else
+    return __builtin_bswap16(input);
+#endif
 }
 uint32_t swapEndianness(uint32_t input) {
-    uint32_t output;
+#ifdef _MSC_VER
+    return _byteswap_ulong(input);
+#else
+    return __builtin_bswap32(input);
+#endif
+}
+uint64_t swapEndianness(uint64_t input) {
+#ifdef _MSC_VER
+    return _byteswap_uint64(input);
+#else
+    return __builtin_bswap64(input);
+#endif
+}
 
-    output = ((input >> 24) & 0xff)     |  // move byte 3 to byte 0
-             ((input << 8 ) & 0xff0000) |  // move byte 1 to byte 2
-             ((input >> 8 ) & 0xff00)   |  // move byte 2 to byte 1
-             ((input << 24) & 0xff000000); // byte 0 to byte 3;
+//Big endian values of Size bytes, Size can be smaller than T (the 24 bit ODS data length).
+//memcpy is used for the unaligned accesses, the compilers turn it in a single load or store.
+template <typename T, size_t Size = sizeof(T)>
+T loadBigEndian(const uint8_t* buffer) {
+    if constexpr (Size == 1) {
+        return (T)buffer[0];
+    }
+    else if constexpr (Size == sizeof(T)) {
+        T value;
+        std::memcpy(&value, buffer, sizeof(T));
+        return swapEndianness(value);
+    }
+    else {
+        T value = 0;
+        for (size_t i = 0; i < Size; i++) {
+            value = (T)((value << 8) | buffer[i]);
+        }
+        return value;
+    }
+}
 
-    return output;
+template <typename T, size_t Size = sizeof(T)>
+void storeBigEndian(uint8_t* buffer, T value) {
+    if constexpr (Size == 1) {
+        buffer[0] = (uint8_t)value;
+    }
+    else if constexpr (Size == sizeof(T)) {
+        value = swapEndianness(value);
+        std::memcpy(buffer, &value, sizeof(T));
+    }
+    else {
+        for (size_t i = 0; i < Size; i++) {
+            buffer[i] = (uint8_t)(value >> (8 * (Size - 1 - i)));
+        }
+    }
 }
 
-t_header t_header::read(uint8_t* buffer) {
-    t_header header = {};
 
-    header.header      = swapEndianness(*(uint16_t*)&buffer[0]);
-    header.pts         = swapEndianness(*(uint32_t*)&buffer[2]);
-    header.dts         = swapEndianness(*(uint32_t*)&buffer[6]);
-    header.segmentType =                *(uint8_t*) &buffer[10];
-    header.dataLength  = swapEndianness(*(uint16_t*)&buffer[11]);
+//The segments are described as a sequence of fields, in the same order of sup-parser.ksy, and both
+//read and write are generated from the same description. The offset of every field is the sum of
+//the sizes of the previous ones.
+template <typename M>
+struct t_memberType;
+template <typename S, typename T>
+struct t_memberType<T S::*> {
+    using type = T;
+};
+
+template <auto Member, size_t Size = sizeof(typename t_memberType<decltype(Member)>::type)>
+struct t_field {
+    using T = typename t_memberType<decltype(Member)>::type;
+    static size_t const size = Size;
+
+    template <typename S>
+    static void read(const uint8_t* buffer, S& s) {
+        s.*Member = loadBigEndian<T, Size>(buffer);
+    }
+    template <typename S>
+    static void write(uint8_t* buffer, const S& s) {
+        storeBigEndian<T, Size>(buffer, s.*Member);
+    }
+};
+
+template <typename... Fields>
+struct t_layout {
+    static constexpr size_t sizes[] = { Fields::size... };
+
+    static constexpr size_t offset(size_t idx) {
+        size_t offset = 0;
+        for (size_t i = 0; i < idx; i++) {
+            offset += sizes[i];
+        }
+        return offset;
+    }
+    static constexpr size_t size = offset(sizeof...(Fields));
+
+    template <typename S>
+    static void read(const uint8_t* buffer, S& s) {
+        readFields(buffer, s, std::index_sequence_for<Fields...>{});
+    }
+    template <typename S>
+    static void write(uint8_t* buffer, const S& s) {
+        writeFields(buffer, s, std::index_sequence_for<Fields...>{});
+    }
+
+private:
+    template <typename S, size_t... I>
+    static void readFields(const uint8_t* buffer, S& s, std::index_sequence<I...>) {
+        (Fields::read(&buffer[offset(I)], s), ...);
+    }
+    template <typename S, size_t... I>
+    static void writeFields(uint8_t* buffer, const S& s, std::index_sequence<I...>) {
+        (Fields::write(&buffer[offset(I)], s), ...);
+    }
+};
+
+using t_headerLayout = t_layout<
+    t_field<&t_header::header>,
+    t_field<&t_header::pts>,
+    t_field<&t_header::dts>,
+    t_field<&t_header::segmentType>,
+    t_field<&t_header::dataLength>>;
+
+using t_pcsLayout = t_layout<
+    t_field<&t_PCS::width>,
+    t_field<&t_PCS::height>,
+    t_field<&t_PCS::frameRate>,
+    t_field<&t_PCS::compositionNumber>,
+    t_field<&t_PCS::compositionState>,
+    t_field<&t_PCS::paletteUpdateFlag>,
+    t_field<&t_PCS::paletteID>,
+    t_field<&t_PCS::numberOfCompositionObjects>>;
+
+using t_compositionObjectLayout = t_layout<
+    t_field<&t_compositionObject::objectID>,
+    t_field<&t_compositionObject::windowID>,
+    t_field<&t_compositionObject::croppedAndForcedFlag>,
+    t_field<&t_compositionObject::horizontalPosition>,
+    t_field<&t_compositionObject::verticalPosition>>;
+
+//Only present if the cropped flag is set
+using t_objectCroppingLayout = t_layout<
+    t_field<&t_compositionObject::croppedHorizontalPosition>,
+    t_field<&t_compositionObject::croppedVerticalPosition>,
+    t_field<&t_compositionObject::croppedWidth>,
+    t_field<&t_compositionObject::croppedHeight>>;
+
+using t_wdsLayout = t_layout<
+    t_field<&t_WDS::numberOfWindows>>;
+
+using t_windowLayout = t_layout<
+    t_field<&t_window::id>,
+    t_field<&t_window::horizontalPosition>,
+    t_field<&t_window::verticalPosition>,
+    t_field<&t_window::width>,
+    t_field<&t_window::height>>;
+
+using t_pdsLayout = t_layout<
+    t_field<&t_PDS::id>,
+    t_field<&t_PDS::versionNumber>>;
+
+using t_paletteLayout = t_layout<
+    t_field<&t_palette::entryID>,
+    t_field<&t_palette::valueY>,
+    t_field<&t_palette::valueCr>,
+    t_field<&t_palette::valueCb>,
+    t_field<&t_palette::valueA>>;
+
+//Every fragment of an object starts with the id, only the first one has the data length and the size
+using t_odsFragmentLayout = t_layout<
+    t_field<&t_ODS::id>,
+    t_field<&t_ODS::versionNumber>,
+    t_field<&t_ODS::sequenceFlag>>;
+
+using t_odsLayout = t_layout<
+    t_field<&t_ODS::id>,
+    t_field<&t_ODS::versionNumber>,
+    t_field<&t_ODS::sequenceFlag>,
+    t_field<&t_ODS::dataLength, 3>,
+    t_field<&t_ODS::width>,
+    t_field<&t_ODS::height>>;
+
+static_assert(t_headerLayout::size == HEADER_SIZE, "PGS header is 13 bytes");
+static_assert(t_pcsLayout::size == 11 && t_compositionObjectLayout::size == 8 && t_objectCroppingLayout::size == 8, "PCS layout");
+static_assert(t_wdsLayout::size == 1 && t_windowLayout::size == 9, "WDS layout");
+static_assert(t_pdsLayout::size == 2 && t_paletteLayout::size == 5, "PDS layout");
+static_assert(t_odsFragmentLayout::size == 4 && t_odsLayout::size == 11, "ODS layout");
+
+
+t_header t_header::read(uint8_t* buffer) {
+    t_header header;
+    t_headerLayout::read(buffer, header);
 
     return header;
 }
 
 void t_header::write(uint8_t* buffer) {
-    *((uint16_t*)(&buffer[0]))  = swapEndianness(header);
-    *((uint32_t*)(&buffer[2]))  = swapEndianness(pts);
-    *((uint32_t*)(&buffer[6]))  = swapEndianness(dts);
-    *((uint8_t*) (&buffer[10])) =                segmentType;
-    *((uint16_t*)(&buffer[11])) = swapEndianness(dataLength);
+    t_headerLayout::write(buffer, *this);
 }
 
 
 t_WDS t_WDS::read(uint8_t* buffer) {
     t_WDS wds;
+    t_wdsLayout::read(buffer, wds);
 
-    wds.numberOfWindows = *(uint8_t*)&buffer[0];
+    size_t pos = t_wdsLayout::size;
     for (int i = 0; i < wds.numberOfWindows; i++) {
-        size_t bufferStartIdx = 1 + (size_t)i * 9;
-
-        wds.windows[i].id                 =                *(uint8_t*) &buffer[bufferStartIdx + 0];
-        wds.windows[i].horizontalPosition = swapEndianness(*(uint16_t*)&buffer[bufferStartIdx + 1]);
-        wds.windows[i].verticalPosition   = swapEndianness(*(uint16_t*)&buffer[bufferStartIdx + 3]);
-        wds.windows[i].width              = swapEndianness(*(uint16_t*)&buffer[bufferStartIdx + 5]);
-        wds.windows[i].height             = swapEndianness(*(uint16_t*)&buffer[bufferStartIdx + 7]);
+        t_windowLayout::read(&buffer[pos], wds.windows[i]);
+        pos += t_windowLayout::size;
     }
 
     return wds;
 }
 
 void t_WDS::write(uint8_t* buffer) {
-    *((uint8_t*)(&buffer[0])) = numberOfWindows;
-    for (int i = 0; i < numberOfWindows; i++) {
-        size_t bufferStartIdx = 1 + (size_t)i * 9;
+    t_wdsLayout::write(buffer, *this);
 
-        *((uint8_t*) (&buffer[bufferStartIdx + 0])) =                windows[i].id;
-        *((uint16_t*)(&buffer[bufferStartIdx + 1])) = swapEndianness(windows[i].horizontalPosition);
-        *((uint16_t*)(&buffer[bufferStartIdx + 3])) = swapEndianness(windows[i].verticalPosition);
-        *((uint16_t*)(&buffer[bufferStartIdx + 5])) = swapEndianness(windows[i].width);
-        *((uint16_t*)(&buffer[bufferStartIdx + 7])) = swapEndianness(windows[i].height);
+    size_t pos = t_wdsLayout::size;
+    for (int i = 0; i < numberOfWindows; i++) {
+        t_windowLayout::write(&buffer[pos], windows[i]);
+        pos += t_windowLayout::size;
     }
 }
 
+//Only the counts are reset, the entries past them are never read
+void t_WDS::clear() {
+    numberOfWindows = 0;
+}
+
 
 t_PCS t_PCS::read(uint8_t* buffer) {
     t_PCS pcs;
+    t_pcsLayout::read(buffer, pcs);
 
-    pcs.width                      = swapEndianness(*(uint16_t*)&buffer[0]);
-    pcs.height                     = swapEndianness(*(uint16_t*)&buffer[2]);
-    pcs.frameRate                  =                *(uint8_t*) &buffer[4];
-    pcs.compositionNumber          = swapEndianness(*(uint16_t*)&buffer[5]);
-    pcs.compositionState           =                *(uint8_t*) &buffer[7];
-    pcs.paletteUpdateFlag          =                *(uint8_t*) &buffer[8];
-    pcs.paletteID                  =                *(uint8_t*) &buffer[9];
-    pcs.numberOfCompositionObjects =                *(uint8_t*) &buffer[10];
-
-    size_t bufferStartIdx = 11;
+    size_t pos = t_pcsLayout::size;
     for (int i = 0; i < pcs.numberOfCompositionObjects; i++) {
-        pcs.compositionObjects[i].objectID                      = swapEndianness(*(uint16_t*)&buffer[bufferStartIdx + 0]);
-        pcs.compositionObjects[i].windowID                      =                *(uint8_t*) &buffer[bufferStartIdx + 2];
-        pcs.compositionObjects[i].croppedAndForcedFlag          =                *(uint8_t*) &buffer[bufferStartIdx + 3];
-        pcs.compositionObjects[i].horizontalPosition            = swapEndianness(*(uint16_t*)&buffer[bufferStartIdx + 4]);
-        pcs.compositionObjects[i].verticalPosition              = swapEndianness(*(uint16_t*)&buffer[bufferStartIdx + 6]);
-        if (pcs.compositionObjects[i].croppedAndForcedFlag & e_objectFlags::cropped) {
-            pcs.compositionObjects[i].croppedHorizontalPosition = swapEndianness(*(uint16_t*)&buffer[bufferStartIdx + 8]);
-            pcs.compositionObjects[i].croppedVerticalPosition   = swapEndianness(*(uint16_t*)&buffer[bufferStartIdx + 10]);
-            pcs.compositionObjects[i].croppedWidth              = swapEndianness(*(uint16_t*)&buffer[bufferStartIdx + 12]);
-            pcs.compositionObjects[i].croppedHeight             = swapEndianness(*(uint16_t*)&buffer[bufferStartIdx + 14]);
-            bufferStartIdx += 8;
+        t_compositionObject& object = pcs.compositionObjects[i];
+        t_compositionObjectLayout::read(&buffer[pos], object);
+        pos += t_compositionObjectLayout::size;
+
+        if (object.croppedAndForcedFlag & e_objectFlags::cropped) {
+            t_objectCroppingLayout::read(&buffer[pos], object);
+            pos += t_objectCroppingLayout::size;
         }
-        bufferStartIdx += 8;
     }
 
     return pcs;
 }
 
 void t_PCS::write(uint8_t* buffer) {
-    *((uint16_t*)(&buffer[0]))  = swapEndianness(width);
-    *((uint16_t*)(&buffer[2]))  = swapEndianness(height);
-    *((uint8_t*) (&buffer[4]))  =                frameRate;
-    *((uint16_t*)(&buffer[5]))  = swapEndianness(compositionNumber);
-    *((uint8_t*) (&buffer[7]))  =                compositionState;
-    *((uint8_t*) (&buffer[8]))  =                paletteUpdateFlag;
-    *((uint8_t*) (&buffer[9]))  =                paletteID;
-    *((uint8_t*) (&buffer[10])) =                numberOfCompositionObjects;
-
-    size_t bufferStartIdx = 11;
+    t_pcsLayout::write(buffer, *this);
+
+    size_t pos = t_pcsLayout::size;
     for (int i = 0; i < numberOfCompositionObjects; i++) {
-        *((uint16_t*)(&buffer[bufferStartIdx + 0]))  = swapEndianness(compositionObjects[i].objectID);
-        *((uint8_t*) (&buffer[bufferStartIdx + 2]))  =                compositionObjects[i].windowID;
-        *((uint8_t*) (&buffer[bufferStartIdx + 3]))  =                compositionObjects[i].croppedAndForcedFlag;
-        *((uint16_t*)(&buffer[bufferStartIdx + 4]))  = swapEndianness(compositionObjects[i].horizontalPosition);
-        *((uint16_t*)(&buffer[bufferStartIdx + 6]))  = swapEndianness(compositionObjects[i].verticalPosition);
-        if (compositionObjects[i].croppedAndForcedFlag & e_objectFlags::cropped) {
-            *((uint16_t*)(&buffer[bufferStartIdx + 8]))  = swapEndianness(compositionObjects[i].croppedHorizontalPosition);
-            *((uint16_t*)(&buffer[bufferStartIdx + 10])) = swapEndianness(compositionObjects[i].croppedVerticalPosition);
-            *((uint16_t*)(&buffer[bufferStartIdx + 12])) = swapEndianness(compositionObjects[i].croppedWidth);
-            *((uint16_t*)(&buffer[bufferStartIdx + 14])) = swapEndianness(compositionObjects[i].croppedHeight);
-            bufferStartIdx += 8;
+        const t_compositionObject& object = compositionObjects[i];
+        t_compositionObjectLayout::write(&buffer[pos], object);
+        pos += t_compositionObjectLayout::size;
+
+        if (object.croppedAndForcedFlag & e_objectFlags::cropped) {
+            t_objectCroppingLayout::write(&buffer[pos], object);
+            pos += t_objectCroppingLayout::size;
         }
-        bufferStartIdx += 8;
     }
 }
 
+void t_PCS::clear() {
+    width                      = 0;
+    height                     = 0;
+    frameRate                  = 0;
+    compositionNumber          = 0;
+    compositionState           = 0;
+    paletteUpdateFlag          = 0;
+    paletteID                  = 0;
+    numberOfCompositionObjects = 0;
+}
+
 
 t_PDS t_PDS::read(uint8_t* buffer, size_t segment_size) {
     t_PDS pds;
+    t_pdsLayout::read(buffer, pds);
 
-    pds.id            = *(uint8_t*)&buffer[0];
-    pds.versionNumber = *(uint8_t*)&buffer[1];
-
-    pds.numberOfPalettes = (segment_size - 2) / 5;
+    pds.numberOfPalettes = (segment_size - t_pdsLayout::size) / t_paletteLayout::size;
 
+    size_t pos = t_pdsLayout::size;
     for (int i = 0; i < pds.numberOfPalettes; i++) {
-        size_t bufferStartIdx = 2 + (size_t)i * 5;
-
-        pds.palettes[i].entryID = *(uint8_t*)&buffer[bufferStartIdx + 0];
-        pds.palettes[i].valueY  = *(uint8_t*)&buffer[bufferStartIdx + 1];
-        pds.palettes[i].valueCb = *(uint8_t*)&buffer[bufferStartIdx + 2];
-        pds.palettes[i].valueCr = *(uint8_t*)&buffer[bufferStartIdx + 3];
-        pds.palettes[i].valueA  = *(uint8_t*)&buffer[bufferStartIdx + 4];
+        t_paletteLayout::read(&buffer[pos], pds.palettes[i]);
+        pos += t_paletteLayout::size;
     }
 
     return pds;
 }
 
 void t_PDS::write(uint8_t* buffer) {
-    *((uint8_t*)(&buffer[0])) = id;
-    *((uint8_t*)(&buffer[1])) = versionNumber;
+    t_pdsLayout::write(buffer, *this);
 
+    size_t pos = t_pdsLayout::size;
     for (int i = 0; i < numberOfPalettes; i++) {
-        size_t bufferStartIdx = 2 + (size_t)i * 5;
-
-        *((uint8_t*)(&buffer[bufferStartIdx + 0])) = palettes[i].entryID;
-        *((uint8_t*)(&buffer[bufferStartIdx + 1])) = palettes[i].valueY;
-        *((uint8_t*)(&buffer[bufferStartIdx + 2])) = palettes[i].valueCb;
-        *((uint8_t*)(&buffer[bufferStartIdx + 3])) = palettes[i].valueCr;
-        *((uint8_t*)(&buffer[bufferStartIdx + 4])) = palettes[i].valueA;
+        t_paletteLayout::write(&buffer[pos], palettes[i]);
+        pos += t_paletteLayout::size;
     }
 }
 
+void t_PDS::clear() {
+    id               = 0;
+    versionNumber    = 0;
+    numberOfPalettes = 0;
+}
+
 
 t_ODS t_ODS::read(uint8_t* buffer) {
     t_ODS ods;
-
-    ods.id            = swapEndianness(*(uint16_t*)&buffer[0]);
-    ods.versionNumber =                *(uint8_t*) &buffer[2];
-    ods.sequenceFlag  =                *(uint8_t*) &buffer[3];
-    ods.dataLength    = swapEndianness(*(uint32_t*)&buffer[3]) & 0xffffff;
-    ods.width         = swapEndianness(*(uint16_t*)&buffer[7]);
-    ods.height        = swapEndianness(*(uint16_t*)&buffer[9]);
+    t_odsLayout::read(buffer, ods);
 
     return ods;
 }
+
+void t_ODS::write(uint8_t* buffer) {
+    t_odsLayout::write(buffer, *this);
+}
+
+void t_ODS::writeFragment(uint8_t* buffer) {
+    t_odsFragmentLayout::write(buffer, *this);
+}
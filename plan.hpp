@@ -0,0 +1,69 @@
+//The options of a job are compiled once, before the stream is read, in what has to be done with each
+//segment type. The processor picks a handler for each type from the plan, so jobs which only change
+//the timestamps (--delay, --resync) patch the headers and never decode, copy or write a body.
+
+enum e_segmentHandling : uint8_t {
+    handlingSkip   = 0, //nothing to do after the header
+    handlingHeader = 1, //the handler only uses the header and the display set state
+    handlingDecode = 2, //the body is decoded but not changed
+    handlingModify = 3  //the body is decoded, modified and encoded back
+};
+
+struct t_plan {
+    bool patchResync = false;
+    bool patchDelay  = false;
+    e_segmentHandling handling[256] = {};
+    bool copyBody[256] = {}; //bodies modified in place, the reader copies them in the display set buffer
+
+    void compile(const t_cmd& cmd, bool doPalette);
+};
+
+void t_plan::compile(const t_cmd& cmd, bool doPalette) {
+    bool doMove     = cmd.move.deltaX != 0 || cmd.move.deltaY != 0;
+    bool doCrop     = (cmd.crop.left + cmd.crop.top + cmd.crop.right + cmd.crop.bottom) > 0;
+    bool textTrace  = cmd.trace && cmd.traceFormat == e_traceFormat::text;
+
+    patchResync = cmd.resync != 1;
+    patchDelay  = cmd.delay != 0;
+
+    std::fill(handling, handling + 256, handlingSkip);
+    std::fill(copyBody, copyBody + 256, false);
+
+    //The PCS is also changed when the objects follow a moved window
+    if (doMove || doCrop || cmd.addZero) {
+        handling[e_segmentType::pcs] = handlingModify;
+    }
+    else if (cmd.trace) {
+        handling[e_segmentType::pcs] = handlingDecode;
+    }
+    else if (cmd.cutMerge.doCutMerge || cmd.stats) {
+        handling[e_segmentType::pcs] = handlingHeader;
+    }
+
+    if (doMove || doCrop) {
+        handling[e_segmentType::wds] = handlingModify;
+    }
+    else if (cmd.trace) {
+        handling[e_segmentType::wds] = handlingDecode;
+    }
+
+    if (doPalette) {
+        handling[e_segmentType::pds] = handlingModify;
+    }
+    else if (textTrace) {
+        handling[e_segmentType::pds] = handlingDecode;
+    }
+
+    //Cropped objects are decoded at the end of the display set and replaced, never changed in place
+    if (textTrace) {
+        handling[e_segmentType::ods] = handlingDecode;
+    }
+
+    handling[e_segmentType::end] = handlingHeader;
+
+    for (int i = 0; i < 256; i++) {
+        copyBody[i] = handling[i] == handlingModify;
+    }
+    //The second pass of Cut&Merge renumbers the PCS
+    copyBody[e_segmentType::pcs] = copyBody[e_segmentType::pcs] || cmd.cutMerge.doCutMerge;
+}
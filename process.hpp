@@ -0,0 +1,862 @@
+struct t_rect {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+};
+
+bool rectIsContained(t_rect container, t_rect window) {
+    if ((window.x + window.width) < (container.x + container.width)
+        && (window.x) > (container.x)
+        && (window.y) > (container.y)
+        && (window.y + window.height) < (container.y + container.height)
+        )
+    {
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+t_rect intersectRect(t_rect a, t_rect b) {
+    int32_t left   = std::max(a.x, b.x);
+    int32_t top    = std::max(a.y, b.y);
+    int32_t right  = std::min(a.x + a.width,  b.x + b.width);
+    int32_t bottom = std::min(a.y + a.height, b.y + b.height);
+
+    t_rect result = {};
+    if (right > left && bottom > top) {
+        result.x      = (uint16_t)left;
+        result.y      = (uint16_t)top;
+        result.width  = (uint16_t)(right - left);
+        result.height = (uint16_t)(bottom - top);
+    }
+
+    return result;
+}
+
+struct t_cropWindow {
+    uint8_t id;
+    t_rect  clip; //visible part of the window, in the coordinates before the crop
+};
+
+struct t_trimmedObject {
+    uint16_t id;
+    uint16_t deltaX; //columns and rows removed from the left and the top of the object
+    uint16_t deltaY;
+};
+
+struct t_objectReplacement {
+    size_t first; //segments of the original object
+    size_t last;
+    std::vector<uint8_t> segments;
+};
+
+
+//Lookup of the Cut&Merge section of a display set. The sections are sorted by begin, so the ones
+//that can contain a PTS are a prefix of the list, and a running maximum of their end tells with a
+//binary search which is the first one reaching it.
+struct t_sectionIndex {
+    const std::vector<t_cutMergeSection>* section = nullptr;
+    std::vector<uint32_t> maxEnd; //highest end among the sections up to each one
+    size_t   cursor    = 0;       //the sections before the cursor all end before cursorPTS
+    uint32_t cursorPTS = 0;
+
+    void init(const std::vector<t_cutMergeSection>& section);
+    size_t firstContaining(uint32_t low, uint32_t high, size_t from);
+    int find(uint32_t beginPTS, uint32_t endPTS, e_cutMergeFixMode fixMode);
+};
+
+void t_sectionIndex::init(const std::vector<t_cutMergeSection>& section) {
+    this->section = &section;
+    cursor = 0;
+    cursorPTS = 0;
+
+    maxEnd.resize(section.size());
+    uint32_t runningMax = 0;
+    for (size_t i = 0; i < section.size(); i++) {
+        runningMax = std::max(runningMax, section[i].end);
+        maxEnd[i] = runningMax;
+    }
+}
+
+//First section with begin <= low and end >= high, SIZE_MAX if none
+size_t t_sectionIndex::firstContaining(uint32_t low, uint32_t high, size_t from) {
+    auto sectionEnd = std::partition_point(section->begin() + from, section->end(), [low](const t_cutMergeSection& s) {
+        return s.begin <= low;
+    });
+    size_t last = sectionEnd - section->begin();
+
+    auto found = std::partition_point(maxEnd.begin() + from, maxEnd.begin() + last, [high](uint32_t end) {
+        return end < high;
+    });
+    size_t idx = found - maxEnd.begin();
+
+    return idx < last ? idx : SIZE_MAX;
+}
+
+//Return the index of the first section containing the display set as described by fixMode, -1 if none
+int t_sectionIndex::find(uint32_t beginPTS, uint32_t endPTS, e_cutMergeFixMode fixMode) {
+    //Display sets arrive in PTS order so the cursor only moves forward, it restarts if they do not
+    uint32_t lowestPTS = std::min(beginPTS, endPTS);
+    if (lowestPTS < cursorPTS) {
+        cursor = 0;
+        cursorPTS = 0;
+    }
+    cursor = std::partition_point(maxEnd.begin() + cursor, maxEnd.end(), [lowestPTS](uint32_t end) {
+        return end < lowestPTS;
+    }) - maxEnd.begin();
+    cursorPTS = lowestPTS;
+
+    //A section "contains" the display set if it includes both begin and end
+    size_t idx = firstContaining(beginPTS, endPTS, cursor);
+
+    if (fixMode == e_cutMergeFixMode::cut) {
+        //Otherwise it is enough that it includes begin or end
+        idx = std::min(idx, firstContaining(beginPTS, beginPTS, cursor));
+        idx = std::min(idx, firstContaining(endPTS, endPTS, cursor));
+    }
+
+    return idx == SIZE_MAX ? -1 : (int)idx;
+}
+
+
+//Timestamp of a segment for the messages, formatted only the first time one needs it
+struct t_lazyTimestamp {
+    uint32_t pts;
+    char     str[32]; //room for any hour value of t_timestamp, a 32 bit PTS is at most 13 hours
+
+    const char* c_str();
+};
+
+const char* t_lazyTimestamp::c_str() {
+    if (str[0] == '\0') {
+        t_timestamp timestamp = ptsToTimestamp(pts);
+        std::snprintf(str, sizeof(str), "%lu:%02lu:%02lu.%03lu", timestamp.hh, timestamp.mm, timestamp.ss, timestamp.ms);
+    }
+    return str;
+}
+
+
+struct t_processor {
+    using t_segmentHandler = void (t_processor::*)(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp);
+
+    const t_cmd* cmd = nullptr;
+    t_supWriter* writer = nullptr; //the dummy display set of --add_zero is written directly here
+    bool  quiet      = false;   //suppress warnings, used when the stream is processed a second time
+    t_traceWriter* trace = nullptr; //records of --trace_format ndjson and csv
+    t_stats stats = {};
+
+    bool doDelay;
+    bool doMove;
+    bool doCrop;
+    bool doResync;
+    bool doTonemap;
+    bool doPalette;
+    bool doModification;
+    bool doAnalysis;
+    bool doTextTrace;
+
+    t_plan plan = {};
+    t_segmentHandler patchHeader;
+    t_segmentHandler segmentHandler[256];
+
+    t_rect screenRect = {};
+    t_paletteLUT paletteLUT;
+
+    t_WDS wds = {};
+    t_PCS pcs = {};
+    t_PDS pds = {};
+    t_ODS ods = {};
+
+    size_t offsetCurrPCS = SIZE_MAX;
+    bool fixPCS = false;
+
+    //Windows bigger than the new screen area are clipped and their objects trimmed at the end of the
+    //display set, when the ODS are known. Trimmed objects are kept for the rest of the epoch as the
+    //following display sets can use them without a new ODS.
+    std::vector<t_cropWindow> crop_windows;
+    t_rect crop_objectPosition[256];
+    std::vector<t_trimmedObject> crop_trimmedObjects;
+    std::vector<t_objectReplacement> crop_replacements;
+
+    uint32_t cutMerge_currentBeginPTS = 0;
+    uint32_t cutMerge_currentEndPTS = 0;
+    uint16_t cutMerge_newCompositionNumber = 0;
+    bool cutMerge_foundBegin = false;
+    bool cutMerge_foundEnd = false;
+    bool cutMerge_pairClosed = false; //the last display set processed closed a pair
+    int  cutMerge_pairSection = -1;   //section containing the closed pair, -1 if it must be deleted
+    t_sectionIndex cutMerge_sectionIndex = {};
+
+    void init(const t_cmd& cmd, t_supWriter* writer);
+    void processDisplaySet(t_displaySet& ds);
+    void processSegment(t_displaySet& ds, t_segment& segment);
+    template <bool Resync, bool Delay>
+    void patchTimestamps(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp);
+    void skipSegment(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp);
+    void handlePCS(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp);
+    void handleWDS(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp);
+    void handlePDS(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp);
+    void handleODS(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp);
+    void handleEND(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp);
+    void cropObjects(t_displaySet& ds, const char* timestampString);
+
+    void cutMergePair(std::vector<t_displaySet>& pair, size_t count);
+};
+
+void t_processor::init(const t_cmd& cmd, t_supWriter* writer) {
+    this->cmd    = &cmd;
+    this->writer = writer;
+
+    doDelay   = cmd.delay != 0;
+    doMove    = cmd.move.deltaX != 0 || cmd.move.deltaY != 0;
+    doCrop    = (cmd.crop.left + cmd.crop.top + cmd.crop.right + cmd.crop.bottom) > 0;
+    doResync  = cmd.resync != 1;
+    doTonemap = cmd.tonemap != 1;
+
+    buildPaletteLUT(cmd, paletteLUT);
+    doPalette = paletteLUT.isActive();
+
+    doModification = doDelay || doMove || doCrop || doResync || cmd.addZero || doTonemap || cmd.cutMerge.doCutMerge || cmd.recover;
+    doAnalysis = cmd.trace || cmd.stats;
+    doTextTrace = cmd.trace && cmd.traceFormat == e_traceFormat::text;
+    stats.timing = cmd.stats;
+
+    plan.compile(cmd, doPalette);
+    if (plan.patchResync) {
+        patchHeader = plan.patchDelay ? &t_processor::patchTimestamps<true, true> : &t_processor::patchTimestamps<true, false>;
+    }
+    else {
+        patchHeader = plan.patchDelay ? &t_processor::patchTimestamps<false, true> : &t_processor::patchTimestamps<false, false>;
+    }
+
+    std::fill(segmentHandler, segmentHandler + 256, &t_processor::skipSegment);
+    if (plan.handling[e_segmentType::pcs] != handlingSkip) segmentHandler[e_segmentType::pcs] = &t_processor::handlePCS;
+    if (plan.handling[e_segmentType::wds] != handlingSkip) segmentHandler[e_segmentType::wds] = &t_processor::handleWDS;
+    if (plan.handling[e_segmentType::pds] != handlingSkip) segmentHandler[e_segmentType::pds] = &t_processor::handlePDS;
+    if (plan.handling[e_segmentType::ods] != handlingSkip) segmentHandler[e_segmentType::ods] = &t_processor::handleODS;
+    if (plan.handling[e_segmentType::end] != handlingSkip) segmentHandler[e_segmentType::end] = &t_processor::handleEND;
+
+    if (cmd.cutMerge.doCutMerge) {
+        cutMerge_sectionIndex.init(cmd.cutMerge.section);
+        cutMerge_newCompositionNumber = cmd.addZero ? 1 : 0;
+    }
+}
+
+void t_processor::processDisplaySet(t_displaySet& ds) {
+    offsetCurrPCS = SIZE_MAX;
+    cutMerge_pairClosed = false;
+    stats.displaySets++;
+
+    for (t_segment& segment : ds.segments) {
+        processSegment(ds, segment);
+    }
+
+    //Replace the trimmed objects starting from the last one, so the indexes of the others stay valid
+    if (!crop_replacements.empty()) {
+        std::sort(crop_replacements.begin(), crop_replacements.end(), [](const t_objectReplacement& a, const t_objectReplacement& b) {
+            return a.first > b.first;
+        });
+        for (t_objectReplacement& replacement : crop_replacements) {
+            stats.modified[operationCrop] += replacement.last - replacement.first + 1;
+            ds.replaceSegments(replacement.first, replacement.last, replacement.segments);
+        }
+        crop_replacements.clear();
+    }
+}
+
+void t_processor::processSegment(t_displaySet& ds, t_segment& segment) {
+    t_header& header = segment.header;
+    t_lazyTimestamp timestamp = { header.pts, {} };
+
+    if (trace != nullptr) {
+        trace->segment(segment, ds.body(segment));
+    }
+    stats.segments[header.segmentType]++;
+    stats.bytes[header.segmentType] += HEADER_SIZE + header.dataLength;
+
+    (this->*patchHeader)(ds, segment, timestamp);
+    (this->*segmentHandler[header.segmentType])(ds, segment, timestamp);
+}
+
+//Resync and delay only change the header, one specialization for each combination
+template <bool Resync, bool Delay>
+void t_processor::patchTimestamps(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp) {
+    t_header& header = segment.header;
+
+    if (Resync) {
+        uint32_t pts = header.pts;
+        header.pts = (uint32_t)std::round((double)header.pts * cmd->resync);
+        stats.modified[operationResync] += header.pts != pts;
+    }
+    if (Delay) {
+        stats.modified[operationDelay] += header.pts != 0 || cmd->delay > 0;
+        if (   cmd->delay < 0
+            && header.pts < abs(cmd->delay)) {
+            if (!quiet) {
+                std::fprintf(stderr, "Object at timestamp %s starts before the full delay amount, it was set to start at 0!\n", timestamp.c_str());
+            }
+            header.pts = 0;
+        }
+        else {
+            header.pts = header.pts + cmd->delay;
+        }
+    }
+
+    if (Resync || Delay) {
+        header.write(&ds.buffer[segment.start]);
+    }
+}
+
+void t_processor::skipSegment(t_displaySet&, t_segment&, t_lazyTimestamp&) {
+}
+
+void t_processor::handlePDS(t_displaySet& ds, t_segment& segment, t_lazyTimestamp&) {
+    uint8_t* body = ds.body(segment);
+    t_header& header = segment.header;
+
+    if (doTextTrace) {
+        pds = t_PDS::read(body, header.dataLength);
+
+        std::printf("  + PDS Segment: offset %#zx\n", segment.offset);
+        std::printf("    + Palette ID: %u\n", pds.id);
+        std::printf("    + Version: %u\n", pds.versionNumber);
+        std::printf("    + Palette entries: %u\n", pds.numberOfPalettes);
+    }
+    if (plan.handling[e_segmentType::pds] == handlingModify) {
+        stats.modified[operationTonemap] += header.dataLength > t_pdsLayout::size;
+        paletteLUT.apply(body, header.dataLength);
+    }
+}
+
+//Only the text trace looks at the ODS while processing the segments
+void t_processor::handleODS(t_displaySet& ds, t_segment& segment, t_lazyTimestamp&) {
+    ods = t_ODS::read(ds.body(segment));
+
+    std::printf("  + ODS Segment: offset %#zx\n", segment.offset);
+    std::printf("    + Object ID: %u\n", ods.id);
+    std::printf("    + Version: %u\n", ods.versionNumber);
+    if (ods.sequenceFlag != e_sequenceFlag::firstAndLast) {
+        std::printf("    + Sequence flag: ");
+        switch (ods.sequenceFlag) {
+            case e_sequenceFlag::last:  std::printf("Last\n"); break;
+            case e_sequenceFlag::first: std::printf("First\n"); break;
+            default:   std::printf("%#x\n", ods.sequenceFlag); break;
+        }
+    }
+    std::printf("    + Size: %ux%u\n", ods.width, ods.height);
+}
+
+void t_processor::handlePCS(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp) {
+    size_t start = segment.start;
+    uint8_t* body = ds.body(segment);
+    t_header& header = segment.header;
+
+    if (doTextTrace) {
+        t_lazyTimestamp dtsTimestamp = { header.dts, {} };
+        std::printf("+ DS\n");
+        std::printf("  + PTS: %s\n", timestamp.c_str());
+        std::printf("  + DTS: %s\n", dtsTimestamp.c_str());
+        std::printf("  + PCS Segment: offset %#zx\n", segment.offset);
+    }
+    if (cmd->stats && header.dataLength > 7 && body[7] == e_compositionState::epochStart) {
+        stats.epochs++;
+    }
+    if (plan.handling[e_segmentType::pcs] >= handlingDecode) {
+        pcs = t_PCS::read(body);
+        offsetCurrPCS = start;
+
+        if (doTextTrace) {
+            std::printf("    + Video size: %ux%u\n", pcs.width, pcs.height);
+            std::printf("    + Composition number: %u\n", pcs.compositionNumber);
+            std::printf("    + Composition state: ");
+            switch (pcs.compositionState) {
+                case e_compositionState::normal:           std::printf("Normal\n"); break;
+                case e_compositionState::acquisitionPoint: std::printf("Aquisition Point\n"); break;
+                case e_compositionState::epochStart:       std::printf("Epoch Start\n"); break;
+                default:                                   std::printf("%#x\n", pcs.compositionState); break;
+            }
+            if (pcs.paletteUpdateFlag == 0x80) {
+                std::printf("    + Palette update: True\n");
+            }
+            std::printf("    + Palette ID: %u\n", pcs.paletteID);
+            for (int i = 0; i < pcs.numberOfCompositionObjects; i++) {
+                std::printf("    + Composition object\n");
+                t_compositionObject object = pcs.compositionObjects[i];
+                std::printf("      + Object ID: %u\n", object.objectID);
+                std::printf("      + Window ID: %u\n", object.windowID);
+                std::printf("      + Position: %u,%u\n", object.horizontalPosition, object.verticalPosition);
+                if (object.croppedAndForcedFlag & e_objectFlags::forced) {
+                    std::printf("      + Forced display: True\n");
+                }
+                if (object.croppedAndForcedFlag & e_objectFlags::cropped) {
+                    std::printf("      + Cropped: True\n");
+                    std::printf("      + Cropped position: %u,%u\n", object.croppedHorizontalPosition, object.croppedVerticalPosition);
+                    std::printf("      + Cropped size: %ux%u\n", object.croppedWidth, object.croppedHeight);
+                }
+            }
+        }
+
+        if (doCrop) {
+            stats.modified[operationCrop]++;
+            screenRect.x      = 0 + cmd->crop.left;
+            screenRect.y      = 0 + cmd->crop.top;
+            screenRect.width  = pcs.width  - (cmd->crop.left + cmd->crop.right);
+            screenRect.height = pcs.height - (cmd->crop.top  + cmd->crop.bottom);
+
+            pcs.width  = screenRect.width;
+            pcs.height = screenRect.height;
+
+            crop_windows.clear();
+            if (pcs.compositionState == e_compositionState::epochStart) {
+                crop_trimmedObjects.clear();
+            }
+            for (int i = 0; i < pcs.numberOfCompositionObjects; i++) {
+                crop_objectPosition[i].x = pcs.compositionObjects[i].horizontalPosition;
+                crop_objectPosition[i].y = pcs.compositionObjects[i].verticalPosition;
+            }
+
+            if (pcs.numberOfCompositionObjects > 1) {
+                if (!quiet) {
+                    std::fprintf(stderr, "Multiple composition object at timestamp %s! Please Check!\n", timestamp.c_str());
+                }
+            }
+
+            for (int i = 0; i < pcs.numberOfCompositionObjects; i++) {
+                if (cmd->crop.left > pcs.compositionObjects[i].horizontalPosition) {
+                    pcs.compositionObjects[i].horizontalPosition = 0;
+                }
+                else {
+                    pcs.compositionObjects[i].horizontalPosition -= cmd->crop.left;
+                }
+
+                if (cmd->crop.top > pcs.compositionObjects[i].verticalPosition) {
+                    pcs.compositionObjects[i].verticalPosition = 0;
+                }
+                else {
+                    pcs.compositionObjects[i].verticalPosition -= cmd->crop.top;
+                }
+            }
+        }
+
+        if (cmd->addZero) {
+            if (pcs.compositionNumber == 0) {
+                uint8_t zeroBuffer[60];
+                uint8_t pos = 0;
+                t_header zeroHeader(header);
+                zeroHeader.pts = 0;
+                zeroHeader.dataLength = 11; //Length of upcoming PCS
+                zeroHeader.write(&zeroBuffer[pos]);
+                pos += 13;
+                t_PCS zeroPcs(pcs);
+                zeroPcs.compositionState = 0;
+                zeroPcs.paletteUpdateFlag = 0;
+                zeroPcs.paletteID = 0;
+                zeroPcs.numberOfCompositionObjects = 0;
+                zeroPcs.write(&zeroBuffer[pos]);
+                pos += zeroHeader.dataLength;
+
+                zeroHeader.segmentType = e_segmentType::wds; // WDS
+                zeroHeader.dataLength = 10; //Length of upcoming WDS
+                zeroHeader.write(&zeroBuffer[pos]);
+                pos += 13;
+                t_WDS zeroWds;
+                zeroWds.numberOfWindows = 1;
+                zeroWds.windows[0].id = 0;
+                zeroWds.windows[0].horizontalPosition = 0;
+                zeroWds.windows[0].verticalPosition = 0;
+                zeroWds.windows[0].width = 0;
+                zeroWds.windows[0].height = 0;
+                zeroWds.write(&zeroBuffer[pos]);
+                pos += zeroHeader.dataLength;
+
+                zeroHeader.segmentType = e_segmentType::end; // END
+                zeroHeader.dataLength = 0; //Length of upcoming END
+                zeroHeader.write(&zeroBuffer[pos]);
+                pos += 13;
+
+                if (writer != nullptr) {
+                    std::fprintf(stderr, "Writing %d bytes as first display set\n", pos);
+                    writer->writeBytes(zeroBuffer, pos);
+                }
+
+                //For Cut&Merge functionality we don't need to save the added segment as it
+                //is saved in the resulting file automatically
+            }
+            pcs.compositionNumber += 1;
+            stats.modified[operationAddZero]++;
+        }
+
+        //Only the crop and the renumbering change the PCS here, the move changes it with the WDS
+        if (doCrop || cmd->addZero) {
+            pcs.write(body);
+        }
+    }
+
+    if (cmd->cutMerge.doCutMerge) {
+        if (!cutMerge_foundBegin) {
+            cutMerge_foundBegin = true;
+            cutMerge_currentBeginPTS = header.pts;
+        }
+        else if (!cutMerge_foundEnd) {
+            cutMerge_foundEnd = true;
+            cutMerge_currentEndPTS = header.pts;
+        }
+    }
+}
+
+void t_processor::handleWDS(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp) {
+    uint8_t* body = ds.body(segment);
+
+    if (doTextTrace) {
+        std::printf("  + WDS Segment: offset %#zx\n", segment.offset);
+    }
+    fixPCS = false;
+    if (plan.handling[e_segmentType::wds] >= handlingDecode) {
+        wds = t_WDS::read(body);
+
+        if (wds.numberOfWindows > 1 && doModification && !quiet) {
+            std::fprintf(stderr, "Multiple windows at timestamp %s! Please Check!\n", timestamp.c_str());
+        }
+
+        if (doTextTrace) {
+            for (int i = 0; i < wds.numberOfWindows; i++) {
+                std::printf("    + Window\n");
+                t_window window = wds.windows[i];
+                std::printf("      + Window ID: %u\n", window.id);
+                std::printf("      + Position: %u,%u\n", window.horizontalPosition, window.verticalPosition);
+                std::printf("      + Size: %ux%u\n", window.width, window.height);
+            }
+        }
+
+        if (doMove) {
+            bool movedWindows = false;
+            bool movedObjects = false;
+            for (int i = 0; i < wds.numberOfWindows; i++) {
+                t_window *window = &wds.windows[i];
+                int16_t minDeltaX = -(int16_t)window->horizontalPosition;
+                int16_t minDeltaY = -(int16_t)window->verticalPosition;
+                int16_t maxDeltaX = pcs.width - (window->horizontalPosition + window->width);
+                int16_t maxDeltaY = pcs.height - (window->verticalPosition + window->height);
+                int16_t clampedDeltaX = std::min(std::max(cmd->move.deltaX, minDeltaX), maxDeltaX);
+                int16_t clampedDeltaY = std::min(std::max(cmd->move.deltaY, minDeltaY), maxDeltaY);
+
+                window->horizontalPosition += clampedDeltaX;
+                window->verticalPosition += clampedDeltaY;
+                movedWindows = movedWindows || clampedDeltaX != 0 || clampedDeltaY != 0;
+
+                for (int j = 0; j < pcs.numberOfCompositionObjects; j++) {
+                    t_compositionObject *object = &pcs.compositionObjects[j];
+                    if (object->windowID != window->id) continue;
+                    if (object->croppedAndForcedFlag & e_objectFlags::cropped) {
+                        object->croppedHorizontalPosition += clampedDeltaX;
+                        object->croppedVerticalPosition += clampedDeltaY;
+                    }
+                    object->horizontalPosition += clampedDeltaX;
+                    object->verticalPosition += clampedDeltaY;
+                    if (doCrop) {
+                        crop_objectPosition[j].x += clampedDeltaX;
+                        crop_objectPosition[j].y += clampedDeltaY;
+                    }
+                    fixPCS = true;
+                    movedObjects = movedObjects || clampedDeltaX != 0 || clampedDeltaY != 0;
+                }
+            }
+            stats.modified[operationMove] += movedWindows + (movedObjects && offsetCurrPCS != SIZE_MAX);
+        }
+
+        if (doCrop) {
+            stats.modified[operationCrop] += wds.numberOfWindows > 0;
+            for (int i = 0; i < wds.numberOfWindows; i++) {
+                t_rect wndRect;
+                uint16_t corrHor = 0;
+                uint16_t corrVer = 0;
+
+                wndRect.x      = wds.windows[i].horizontalPosition;
+                wndRect.y      = wds.windows[i].verticalPosition;
+                wndRect.width  = wds.windows[i].width;
+                wndRect.height = wds.windows[i].height;
+
+                if (wndRect.width > screenRect.width
+                    || wndRect.height > screenRect.height) {
+                    if (!quiet) {
+                        std::fprintf(stderr, "Window is bigger than new screen area at timestamp %s, its objects will be cropped\n", timestamp.c_str());
+                    }
+
+                    t_rect clip = intersectRect(screenRect, wndRect);
+                    if (clip.width == 0 || clip.height == 0) {
+                        if (!quiet) {
+                            std::fprintf(stderr, "Window is outside new screen area at timestamp %s\n", timestamp.c_str());
+                        }
+                        clip.x = screenRect.x;
+                        clip.y = screenRect.y;
+                    }
+                    crop_windows.push_back({ wds.windows[i].id, clip });
+
+                    wds.windows[i].horizontalPosition = clip.x - screenRect.x;
+                    wds.windows[i].verticalPosition   = clip.y - screenRect.y;
+                    wds.windows[i].width              = clip.width;
+                    wds.windows[i].height             = clip.height;
+                    continue;
+                }
+                else {
+                    if (!rectIsContained(screenRect, wndRect)) {
+                        if (!quiet) {
+                            std::fprintf(stderr, "Window is outside new screen area at timestamp %s\n", timestamp.c_str());
+                        }
+
+                        uint16_t wndRightPoint    = wndRect.x    + wndRect.width;
+                        uint16_t screenRightPoint = screenRect.x + screenRect.width;
+                        if (wndRightPoint > screenRightPoint) {
+                            corrHor = wndRightPoint - screenRightPoint;
+                        }
+
+                        uint16_t wndBottomPoint    = wndRect.y    + wndRect.height;
+                        uint16_t screenBottomPoint = screenRect.y + screenRect.height;
+                        if (wndBottomPoint > screenBottomPoint) {
+                            corrVer = wndBottomPoint - screenBottomPoint;
+                        }
+
+                        if (corrHor + corrVer != 0 && !quiet) {
+                            std::fprintf(stderr, "Please check\n");
+                        }
+                    }
+                }
+
+                if (cmd->crop.left > wds.windows[i].horizontalPosition) {
+                    wds.windows[i].horizontalPosition = 0;
+                }
+                else {
+                    wds.windows[i].horizontalPosition -= (cmd->crop.left + corrHor);
+                }
+
+                if (cmd->crop.top > wds.windows[i].verticalPosition) {
+                    wds.windows[i].verticalPosition = 0;
+                }
+                else {
+                    wds.windows[i].verticalPosition -= (cmd->crop.top + corrVer);
+                }
+
+                if (corrVer != 0 || corrHor != 0) {
+                    for (int j = 0; j < pcs.numberOfCompositionObjects; j++) {
+                        if (pcs.compositionObjects[j].windowID != wds.windows[i].id) continue;
+                        pcs.compositionObjects[j].verticalPosition -= corrVer;
+                        pcs.compositionObjects[j].horizontalPosition -= corrHor;
+                    }
+                    fixPCS = true;
+                }
+            }
+        }
+
+        if (fixPCS && offsetCurrPCS != SIZE_MAX) {
+            pcs.write(&ds.buffer[offsetCurrPCS + HEADER_SIZE]);
+        }
+        if (plan.handling[e_segmentType::wds] == handlingModify) {
+            wds.write(body);
+        }
+
+    }
+}
+
+void t_processor::handleEND(t_displaySet& ds, t_segment& segment, t_lazyTimestamp& timestamp) {
+    if (doTextTrace) {
+        std::printf("  + END Segment: offset %#zx\n", segment.offset);
+    }
+
+    if (cmd->cutMerge.doCutMerge) {
+        if (cutMerge_foundEnd) {
+            cutMerge_foundBegin = false;
+            cutMerge_foundEnd = false;
+            cutMerge_pairClosed = true;
+            cutMerge_pairSection = cutMerge_sectionIndex.find(cutMerge_currentBeginPTS, cutMerge_currentEndPTS, cmd->cutMerge.fixMode);
+        }
+    }
+
+    if (!crop_windows.empty()) {
+        cropObjects(ds, timestamp.c_str());
+        crop_windows.clear();
+    }
+
+    screenRect = {};
+    pcs.clear();
+    wds.clear();
+}
+
+//Trim the objects of the windows clipped to the new screen area, the ODS found in the display set
+//are decoded, cut to the visible part and encoded again
+void t_processor::cropObjects(t_displaySet& ds, const char* timestampString) {
+    for (t_cropWindow& window : crop_windows) {
+        for (int j = 0; j < pcs.numberOfCompositionObjects; j++) {
+            t_compositionObject& object = pcs.compositionObjects[j];
+            if (object.windowID != window.id) continue;
+
+            //Only the cropping rectangle of the object is shown, it is narrowed to the visible part and
+            //the bitmap is left as it is
+            if (object.croppedAndForcedFlag & e_objectFlags::cropped) {
+                t_rect shown   = { crop_objectPosition[j].x, crop_objectPosition[j].y, object.croppedWidth, object.croppedHeight };
+                t_rect visible = intersectRect(shown, window.clip);
+                if (visible.width == 0 || visible.height == 0) {
+                    if (!quiet) {
+                        std::fprintf(stderr, "Object %u is outside new screen area at timestamp %s\n", object.objectID, timestampString);
+                    }
+                    continue;
+                }
+
+                //The cropping rectangle is in the coordinates of the bitmap, which may have been trimmed in this epoch
+                auto trimmed = std::find_if(crop_trimmedObjects.begin(), crop_trimmedObjects.end(), [&](const t_trimmedObject& t) {
+                    return t.id == object.objectID;
+                });
+                int32_t croppedX = object.croppedHorizontalPosition + (visible.x - shown.x);
+                int32_t croppedY = object.croppedVerticalPosition   + (visible.y - shown.y);
+                if (trimmed != crop_trimmedObjects.end()) {
+                    croppedX -= trimmed->deltaX;
+                    croppedY -= trimmed->deltaY;
+                }
+                object.croppedHorizontalPosition = (uint16_t)std::max(0, croppedX);
+                object.croppedVerticalPosition   = (uint16_t)std::max(0, croppedY);
+                object.croppedWidth              = visible.width;
+                object.croppedHeight             = visible.height;
+                object.horizontalPosition        = visible.x - screenRect.x;
+                object.verticalPosition          = visible.y - screenRect.y;
+                fixPCS = true;
+                continue;
+            }
+
+            //The ODS of the object in this display set, if any
+            size_t first = SIZE_MAX;
+            for (size_t i = 0; i < ds.segments.size(); i++) {
+                t_segment& segment = ds.segments[i];
+                if (segment.header.segmentType == e_segmentType::ods
+                    && segment.header.dataLength >= ODS_FIRST_HEADER_SIZE
+                    && loadBigEndian<uint16_t>(ds.body(segment)) == object.objectID
+                    && (ds.body(segment)[3] & e_sequenceFlag::first)) {
+                    first = i;
+                    break;
+                }
+            }
+            for (t_objectReplacement& replacement : crop_replacements) {
+                if (replacement.first == first) {
+                    first = SIZE_MAX; //already trimmed for another composition object
+                }
+            }
+
+            t_rect position = crop_objectPosition[j];
+            auto trimmed = std::find_if(crop_trimmedObjects.begin(), crop_trimmedObjects.end(), [&](const t_trimmedObject& t) {
+                return t.id == object.objectID;
+            });
+
+            if (first != SIZE_MAX) {
+                t_ODS objectODS;
+                t_bitmap bitmap;
+                size_t last;
+                if (!decodeObject(ds, first, objectODS, bitmap, last)) {
+                    std::fprintf(stderr, "Unable to decode object %u at timestamp %s\n", object.objectID, timestampString);
+                    continue;
+                }
+
+                t_rect objectRect = { position.x, position.y, bitmap.width, bitmap.height };
+                t_rect visible = intersectRect(objectRect, window.clip);
+                if (visible.width == 0 || visible.height == 0) {
+                    if (!quiet) {
+                        std::fprintf(stderr, "Object %u is outside new screen area at timestamp %s\n", object.objectID, timestampString);
+                    }
+                    continue;
+                }
+
+                t_trimmedObject trim = { object.objectID, (uint16_t)(visible.x - position.x), (uint16_t)(visible.y - position.y) };
+                if (trimmed != crop_trimmedObjects.end()) {
+                    *trimmed = trim;
+                }
+                else {
+                    trimmed = crop_trimmedObjects.insert(crop_trimmedObjects.end(), trim);
+                }
+
+                if (visible.width != bitmap.width || visible.height != bitmap.height) {
+                    t_bitmap cropped;
+                    cropped.resize(visible.width, visible.height);
+                    for (size_t row = 0; row < visible.height; row++) {
+                        std::memcpy(&cropped.pixels[row * visible.width],
+                            &bitmap.pixels[(trim.deltaY + row) * bitmap.width + trim.deltaX],
+                            visible.width);
+                    }
+
+                    std::vector<uint8_t> data;
+                    encodeRLE(cropped, data);
+
+                    t_objectReplacement replacement = { first, last, {} };
+                    writeObjectSegments(ds.segments[first].header, objectODS, cropped, data, replacement.segments);
+                    crop_replacements.push_back(std::move(replacement));
+                }
+            }
+            else if (trimmed == crop_trimmedObjects.end()) {
+                if (!quiet) {
+                    std::fprintf(stderr, "Object %u at timestamp %s was not cropped in this epoch, its position is not fixed!\n", object.objectID, timestampString);
+                }
+                continue;
+            }
+
+            int32_t newX = position.x + trimmed->deltaX - screenRect.x;
+            int32_t newY = position.y + trimmed->deltaY - screenRect.y;
+            object.horizontalPosition = (uint16_t)std::max(0, newX);
+            object.verticalPosition   = (uint16_t)std::max(0, newY);
+            fixPCS = true;
+        }
+    }
+
+    if (fixPCS && offsetCurrPCS != SIZE_MAX) {
+        pcs.write(&ds.buffer[offsetCurrPCS + HEADER_SIZE]);
+    }
+}
+
+
+//Cut&Merge needs the timestamps of both the display set showing the subtitle and the one clearing
+//it, once the pair is known to be inside a section its segments are moved to the merged timeline
+void t_processor::cutMergePair(std::vector<t_displaySet>& pair, size_t count) {
+    t_cutMergeSection section = cmd->cutMerge.section[cutMerge_pairSection];
+    bool foundBegin = false;
+    bool foundEnd = false;
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t* buffer = pair[i].buffer.data();
+
+        for (t_segment& segment : pair[i].segments) {
+            size_t start = segment.start;
+            t_header& header = segment.header;
+
+            //Only the header (for the PTS) and the PCS (for the compositionNumber) are modified
+            if (header.segmentType == e_segmentType::pcs && !foundEnd) {
+                pcs = t_PCS::read(&buffer[start + HEADER_SIZE]);
+                pcs.compositionNumber = cutMerge_newCompositionNumber;
+                pcs.write(&buffer[start + HEADER_SIZE]);
+
+                foundEnd = foundBegin;
+                foundBegin = true;
+            }
+            if (!foundBegin) {
+                continue;
+            }
+
+            if (!foundEnd) {
+                if (cutMerge_currentBeginPTS < section.begin) {
+                    header.pts = section.begin;
+                }
+            }
+            else {
+                if (cutMerge_currentEndPTS > section.end) {
+                    header.pts = section.end;
+                }
+            }
+
+            header.pts -= section.delay_until;
+
+            header.write(&buffer[start]);
+            stats.modified[operationCutMerge]++;
+        }
+    }
+
+    pcs.clear();
+    cutMerge_newCompositionNumber++;
+}
@@ -0,0 +1,249 @@
+//PGS object bitmaps are stored run-length encoded, one palette index per pixel:
+//  CCCCCCCC                              1 pixel of color C (C != 0)
+//  00000000 00000000                     end of line
+//  00000000 00LLLLLL                     L pixels of color 0 (L < 64)
+//  00000000 01LLLLLL LLLLLLLL            L pixels of color 0 (L < 16384)
+//  00000000 10LLLLLL CCCCCCCC            L pixels of color C (2 < L < 64)
+//  00000000 11LLLLLL LLLLLLLL CCCCCCCC   L pixels of color C (L < 16384)
+//An object can be split in more ODS segments, the first one carries the object data length and the
+//bitmap size, the following ones only the object id, version and sequence flag.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SUPMOVER_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+size_t const ODS_FIRST_HEADER_SIZE = t_odsLayout::size;         //id, version, sequence flag, data length, width and height
+size_t const ODS_NEXT_HEADER_SIZE  = t_odsFragmentLayout::size; //id, version and sequence flag
+size_t const RLE_MAX_RUN           = 16383;
+
+struct t_bitmap {
+    uint16_t width  = 0;
+    uint16_t height = 0;
+    std::vector<uint8_t> pixels; //one palette index per pixel, width * height
+
+    void resize(uint16_t width, uint16_t height);
+};
+
+void t_bitmap::resize(uint16_t width, uint16_t height) {
+    this->width  = width;
+    this->height = height;
+    pixels.assign((size_t)width * height, 0);
+}
+
+
+//Decode the RLE data in the bitmap, which must already have its size set.
+//Return false if the data is truncated or a line is longer than the bitmap width.
+bool decodeRLE(const uint8_t* data, size_t size, t_bitmap& bitmap) {
+    size_t pos = 0;
+    uint8_t* line = bitmap.pixels.data();
+    size_t width = bitmap.width;
+    size_t x = 0;
+    size_t y = 0;
+
+    while (pos < size && y < bitmap.height) {
+        uint8_t color = data[pos++];
+        size_t length = 1;
+
+        if (color == 0) {
+            if (pos >= size) return false;
+            uint8_t flags = data[pos++];
+
+            if (flags == 0) {
+                //Lines shorter than the bitmap are left transparent
+                x = 0;
+                y++;
+                line += width;
+                continue;
+            }
+
+            length = flags & 0x3F;
+            if (flags & 0x40) {
+                if (pos >= size) return false;
+                length = (length << 8) | data[pos++];
+            }
+            if (flags & 0x80) {
+                if (pos >= size) return false;
+                color = data[pos++];
+            }
+        }
+
+        if (x + length > width) {
+            return false;
+        }
+        if (length == 1) {
+            line[x] = color;
+        }
+        else {
+            std::memset(&line[x], color, length);
+        }
+        x += length;
+    }
+
+    return true;
+}
+
+
+//Length of the run of pixels equal to pixels[0], at most maxLength
+size_t runLength(const uint8_t* pixels, size_t maxLength) {
+    uint8_t color = pixels[0];
+    size_t length = 1;
+
+#ifdef SUPMOVER_SSE2
+    __m128i broadcast = _mm_set1_epi8((char)color);
+    while (length + 16 <= maxLength) {
+        __m128i block = _mm_loadu_si128((const __m128i*)&pixels[length]);
+        unsigned int equal = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, broadcast));
+        if (equal != 0xFFFF) {
+            unsigned int different = ~equal & 0xFFFF;
+#ifdef _MSC_VER
+            unsigned long idx;
+            _BitScanForward(&idx, different);
+#else
+            unsigned int idx = (unsigned int)__builtin_ctz(different);
+#endif
+            return length + idx;
+        }
+        length += 16;
+    }
+#endif
+
+    while (length < maxLength && pixels[length] == color) {
+        length++;
+    }
+
+    return length;
+}
+
+void encodeRun(uint8_t color, size_t length, std::vector<uint8_t>& out) {
+    if (color != 0 && length < 3) {
+        out.insert(out.end(), length, color);
+        return;
+    }
+
+    uint8_t flags = color != 0 ? 0x80 : 0x00;
+    out.push_back(0);
+    if (length < 64) {
+        out.push_back(flags | (uint8_t)length);
+    }
+    else {
+        out.push_back(flags | 0x40 | (uint8_t)(length >> 8));
+        out.push_back((uint8_t)(length & 0xFF));
+    }
+    if (color != 0) {
+        out.push_back(color);
+    }
+}
+
+//Encode the bitmap appending the RLE data to out
+void encodeRLE(const t_bitmap& bitmap, std::vector<uint8_t>& out) {
+    out.reserve(out.size() + bitmap.pixels.size() / 4 + (size_t)bitmap.height * 2);
+
+    for (size_t y = 0; y < bitmap.height; y++) {
+        const uint8_t* line = &bitmap.pixels[y * bitmap.width];
+        size_t x = 0;
+
+        while (x < bitmap.width) {
+            size_t length = runLength(&line[x], std::min(bitmap.width - x, RLE_MAX_RUN));
+            encodeRun(line[x], length, out);
+            x += length;
+        }
+
+        out.push_back(0);
+        out.push_back(0);
+    }
+}
+
+
+//Gather the RLE data of the object starting at segment idx of the display set, following its
+//fragments up to the one with the last sequence flag. lastIdx is set to the index of that segment.
+bool readObjectData(t_displaySet& ds, size_t idx, t_ODS& ods, std::vector<uint8_t>& data, size_t& lastIdx) {
+    t_segment& first = ds.segments[idx];
+    if (first.header.dataLength < ODS_FIRST_HEADER_SIZE) {
+        return false;
+    }
+
+    ods = t_ODS::read(ds.body(first));
+    if (!(ods.sequenceFlag & e_sequenceFlag::first)) {
+        return false;
+    }
+
+    uint8_t* body = ds.body(first);
+    data.assign(&body[ODS_FIRST_HEADER_SIZE], &body[first.header.dataLength]);
+    lastIdx = idx;
+
+    while (!(ds.segments[lastIdx].header.dataLength >= ODS_NEXT_HEADER_SIZE
+             && (ds.body(ds.segments[lastIdx])[3] & e_sequenceFlag::last))) {
+        lastIdx++;
+        if (lastIdx >= ds.segments.size()) {
+            return false;
+        }
+
+        t_segment& next = ds.segments[lastIdx];
+        if (next.header.segmentType != e_segmentType::ods
+            || next.header.dataLength < ODS_NEXT_HEADER_SIZE) {
+            return false;
+        }
+        body = ds.body(next);
+        if (loadBigEndian<uint16_t>(&body[0]) != ods.id) {
+            return false;
+        }
+        data.insert(data.end(), &body[ODS_NEXT_HEADER_SIZE], &body[next.header.dataLength]);
+    }
+
+    return true;
+}
+
+//Decode the object starting at segment idx of the display set
+bool decodeObject(t_displaySet& ds, size_t idx, t_ODS& ods, t_bitmap& bitmap, size_t& lastIdx) {
+    std::vector<uint8_t> data;
+    if (!readObjectData(ds, idx, ods, data, lastIdx)) {
+        return false;
+    }
+
+    bitmap.resize(ods.width, ods.height);
+
+    return decodeRLE(data.data(), data.size(), bitmap);
+}
+
+//Write the ODS segments of an object, split in more fragments if the data does not fit in one.
+//header is used as template for the segment headers (timestamps).
+void writeObjectSegments(const t_header& header, const t_ODS& ods, const t_bitmap& bitmap, const std::vector<uint8_t>& data, std::vector<uint8_t>& out) {
+    size_t pos = 0;
+    bool first = true;
+
+    do {
+        size_t headerSize = first ? ODS_FIRST_HEADER_SIZE : ODS_NEXT_HEADER_SIZE;
+        size_t length = std::min(data.size() - pos, (size_t)UINT16_MAX - headerSize);
+        bool last = pos + length == data.size();
+
+        t_header segmentHeader = header;
+        segmentHeader.segmentType = e_segmentType::ods;
+        segmentHeader.dataLength = (uint16_t)(headerSize + length);
+
+        size_t start = out.size();
+        out.resize(start + HEADER_SIZE + headerSize);
+        uint8_t* buffer = &out[start];
+        segmentHeader.write(buffer);
+        buffer += HEADER_SIZE;
+
+        t_ODS fragment = ods;
+        fragment.sequenceFlag = (first ? e_sequenceFlag::first : 0) | (last ? e_sequenceFlag::last : 0);
+        if (first) {
+            fragment.dataLength = (uint32_t)data.size() + 4; //width and height are included
+            fragment.width      = bitmap.width;
+            fragment.height     = bitmap.height;
+            fragment.write(buffer);
+        }
+        else {
+            fragment.writeFragment(buffer);
+        }
+
+        out.insert(out.end(), data.begin() + pos, data.begin() + pos + length);
+        pos += length;
+        first = false;
+    } while (pos < data.size());
+}
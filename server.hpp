@@ -0,0 +1,332 @@
+//Server mode: a long running process accepts jobs on a local Unix socket and runs them on a pool of
+//worker threads, so every job does not pay for a process start. The client mode sends its command
+//line to the server and exits with the result of the job, so scripts only need to add
+//"--client <socket>" in front of the arguments.
+//
+//A connection can send many jobs, one per line with the syntax of the batch manifest. For each job
+//the server answers "<result> <size>\n" followed by size bytes of text: the statistics of the job
+//(in the format requested by the job, JSON if it did not request them) or the reason of the failure.
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SUPMOVER_SERVER
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#ifdef SUPMOVER_SERVER
+struct t_server {
+    const char* socketPath = nullptr;
+    uint32_t threads = 0; //0 means one per hardware thread
+    int listenFd = -1;
+
+    std::mutex mutex;
+    std::condition_variable connectionReady;
+    std::vector<int> connections; //accepted connections waiting for a worker
+};
+
+//Usage: SupMover --server <socket> [--threads <n>]
+bool parseServerCMD(int32_t argc, char** argv, t_server& server) {
+    if (argc < 3) return false;
+    server.socketPath = argv[2];
+
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "threads" || arg == "--threads") && i + 1 < argc) {
+            server.threads = (uint32_t)std::atoi(argv[++i]);
+        }
+        else {
+            std::fprintf(stderr, "Unrecognized server option %s\n", argv[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool makeSocketAddress(const char* path, struct sockaddr_un& address) {
+    address = {};
+    address.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(address.sun_path)) {
+        std::fprintf(stderr, "Socket path %s is too long\n", path);
+        return false;
+    }
+    std::strcpy(address.sun_path, path);
+
+    return true;
+}
+
+bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, 0);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= (size_t)sent;
+    }
+
+    return true;
+}
+
+//Read a line without the newline, return false at the end of the connection
+bool receiveLine(int fd, std::string& pending, std::string& line) {
+    while (true) {
+        size_t newline = pending.find('\n');
+        if (newline != std::string::npos) {
+            line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            return true;
+        }
+
+        char data[4096];
+        ssize_t received = recv(fd, data, sizeof(data), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        pending.append(data, (size_t)received);
+    }
+}
+
+bool sendResult(int fd, int result, const std::string& text) {
+    char header[64];
+    int size = std::snprintf(header, sizeof(header), "%d %zu\n", result, text.size());
+
+    return sendAll(fd, header, (size_t)size) && sendAll(fd, text.data(), text.size());
+}
+
+//Run a job received by the server, the files are opened by the server so their paths must be absolute
+int runServerJob(const std::string& line, std::string& text) {
+    t_batchJob job = {};
+    job.args = splitManifestLine(line);
+    job.args.insert(job.args.begin(), "SupMover");
+
+    if (job.args.size() < 2 || !parseJobArgs(job)) {
+        text = "Error parsing input\n";
+        return -1;
+    }
+    if (isStandardStream(job.cmd.inputFile) || isStandardStream(job.cmd.outputFile)) {
+        text = "The server cannot use the standard input and output\n";
+        return -1;
+    }
+    if (job.cmd.trace) {
+        text = "The trace is not available in server mode\n";
+        return -1;
+    }
+
+    //The statistics are always returned to the client
+    if (!job.cmd.stats) {
+        job.cmd.stats = true;
+        job.cmd.statsFormat = e_statsFormat::json;
+    }
+
+    job.cmd.sharedProcess = true;
+    int result = processFile(job.cmd, &text);
+    if (result != 0) {
+        text = "Job " + std::string(job.cmd.inputFile) + " failed, the errors are in the log of the server\n";
+    }
+
+    return result;
+}
+
+void serveConnection(int fd) {
+    std::string pending;
+    std::string line;
+
+    while (receiveLine(fd, pending, line)) {
+        if (line.empty()) {
+            continue;
+        }
+
+        std::string text;
+        int result = runServerJob(line, text);
+        if (!sendResult(fd, result, text)) {
+            break;
+        }
+    }
+
+    close(fd);
+}
+
+int runServer(t_server& server) {
+    struct sockaddr_un address;
+    if (!makeSocketAddress(server.socketPath, address)) {
+        return -1;
+    }
+
+    //A client closing the connection before reading the result must not stop the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    server.listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listenFd < 0) {
+        std::fprintf(stderr, "Unable to create socket!\n");
+        return -1;
+    }
+    unlink(server.socketPath);
+
+    //Only the user running the server can connect, whatever the umask. The workers are not started
+    //yet, so changing the umask of the process for the bind affects no other file.
+    mode_t mask = umask(0177);
+    bool bound = bind(server.listenFd, (struct sockaddr*)&address, sizeof(address)) == 0;
+    umask(mask);
+    if (!bound || chmod(server.socketPath, 0600) != 0 || listen(server.listenFd, SOMAXCONN) != 0) {
+        std::fprintf(stderr, "Unable to listen on socket %s!\n", server.socketPath);
+        close(server.listenFd);
+        return -1;
+    }
+
+    uint32_t threads = server.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    auto worker = [&server]() {
+        while (true) {
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(server.mutex);
+                server.connectionReady.wait(lock, [&server]() { return !server.connections.empty(); });
+                fd = server.connections.front();
+                server.connections.erase(server.connections.begin());
+            }
+            serveConnection(fd);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (uint32_t i = 0; i < threads; i++) {
+        pool.emplace_back(worker);
+    }
+    std::fprintf(stderr, "Listening on %s with %u threads\n", server.socketPath, threads);
+
+    while (true) {
+        int fd = accept(server.listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::fprintf(stderr, "Unable to accept connections!\n");
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(server.mutex);
+            server.connections.push_back(fd);
+        }
+        server.connectionReady.notify_one();
+    }
+
+    //The workers wait for connections forever, they end with the process
+    for (std::thread& thread : pool) {
+        thread.detach();
+    }
+    close(server.listenFd);
+    unlink(server.socketPath);
+
+    return -1;
+}
+
+//Quote an argument for splitManifestLine, which has no escape for double quotes
+bool quoteArgument(const std::string& arg, std::string& line) {
+    if (arg.find('"') != std::string::npos) {
+        std::fprintf(stderr, "Argument %s cannot be sent to the server\n", arg.c_str());
+        return false;
+    }
+
+    line += line.empty() ? "\"" : " \"";
+    line += arg;
+    line += '"';
+
+    return true;
+}
+
+//Usage: SupMover --client <socket> <input.sup> [<output.sup>] [OPTIONS ...]
+//main prints the usage when the arguments are missing
+int runClient(int32_t argc, char** argv) {
+    if (argc < 4) {
+        return -1;
+    }
+
+    //The command line is checked here, so the errors are reported by the client
+    std::vector<char*> jobArgv = { argv[0] };
+    jobArgv.insert(jobArgv.end(), argv + 3, argv + argc);
+    t_cmd cmd = {};
+    if (!parseCMD((int32_t)jobArgv.size(), jobArgv.data(), cmd)) {
+        std::fprintf(stderr, "Error parsing input\n");
+        return -1;
+    }
+    if (isStandardStream(cmd.inputFile) || isStandardStream(cmd.outputFile) || cmd.trace) {
+        std::fprintf(stderr, "The standard input and output and the trace cannot be used with the server\n");
+        return -1;
+    }
+
+    //The server has its own working directory
+    std::string line;
+    for (size_t i = 1; i < jobArgv.size(); i++) {
+        std::string arg = jobArgv[i];
+        if (jobArgv[i] == cmd.inputFile || jobArgv[i] == cmd.outputFile) {
+            std::error_code error;
+            arg = std::filesystem::absolute(arg, error).string();
+        }
+        if (!quoteArgument(arg, line)) {
+            return -1;
+        }
+    }
+    line += '\n';
+
+    struct sockaddr_un address;
+    if (!makeSocketAddress(argv[2], address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        std::fprintf(stderr, "Unable to connect to server %s!\n", argv[2]);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    std::string pending;
+    std::string header;
+    if (!sendAll(fd, line.data(), line.size()) || !receiveLine(fd, pending, header)) {
+        std::fprintf(stderr, "Connection to the server lost!\n");
+        close(fd);
+        return -1;
+    }
+
+    int result = -1;
+    size_t size = 0;
+    if (std::sscanf(header.c_str(), "%d %zu", &result, &size) != 2) {
+        std::fprintf(stderr, "Invalid answer from the server!\n");
+        close(fd);
+        return -1;
+    }
+    while (pending.size() < size) {
+        char data[4096];
+        ssize_t received = recv(fd, data, sizeof(data), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+        pending.append(data, (size_t)received);
+    }
+    close(fd);
+
+    //Like the command line, the statistics are only printed when requested
+    if (result != 0 || cmd.stats) {
+        std::fwrite(pending.data(), 1, std::min(size, pending.size()), stderr);
+    }
+
+    return result;
+}
+#endif
@@ -0,0 +1,278 @@
+//Statistics of --stats: the counters are plain increments done by the processor for every segment,
+//the phases are timed with the monotonic clock only when the statistics are requested, once each
+//time the job moves from a phase to the next. CPU time and peak memory are read from the system at
+//the beginning and at the end of the job, reading the thread CPU time at every phase change would
+//cost a system call for every display set. The jobs of batch and server mode share the process, their
+//CPU time is the one of their thread where the system tells it (Linux and Windows), otherwise it is
+//not reported.
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+enum e_statsPhase : uint8_t {
+    phaseRead     = 0,
+    phaseProcess  = 1,
+    phaseCutMerge = 2, //second pass on the display sets of a pair inside a section
+    phaseWrite    = 3,
+    PHASES        = 4
+};
+
+const char* const statsPhaseNames[PHASES] = { "read", "process", "cut_merge", "write" };
+
+enum e_statsOperation : uint8_t {
+    operationDelay    = 0,
+    operationResync   = 1,
+    operationMove     = 2,
+    operationCrop     = 3,
+    operationTonemap  = 4,
+    operationAddZero  = 5,
+    operationCutMerge = 6,
+    OPERATIONS        = 7
+};
+
+const char* const statsOperationNames[OPERATIONS] = { "delay", "resync", "move", "crop", "tonemap", "add_zero", "cut_merge" };
+
+struct t_resourceUsage {
+    double userSeconds   = 0;
+    double systemSeconds = 0;
+    bool   cpuTime       = true; //false if the CPU time could not be measured
+    size_t peakMemory    = 0; //bytes
+};
+
+//With perThread the CPU time is the one of the calling thread, the peak memory is always the one of
+//the process
+t_resourceUsage getResourceUsage(bool perThread = false) {
+    t_resourceUsage usage = {};
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        usage.userSeconds   = (double)ru.ru_utime.tv_sec + (double)ru.ru_utime.tv_usec / 1e6;
+        usage.systemSeconds = (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+        usage.peakMemory    = (size_t)ru.ru_maxrss;
+#else
+        usage.peakMemory    = (size_t)ru.ru_maxrss * 1024;
+#endif
+    }
+    if (perThread) {
+#ifdef RUSAGE_THREAD
+        usage.cpuTime = getrusage(RUSAGE_THREAD, &ru) == 0;
+        usage.userSeconds   = (double)ru.ru_utime.tv_sec + (double)ru.ru_utime.tv_usec / 1e6;
+        usage.systemSeconds = (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec / 1e6;
+#else
+        usage.cpuTime = false;
+#endif
+    }
+#elif defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    if (perThread ? GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)
+                  : GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        usage.userSeconds   = (double)(((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime) / 1e7;
+        usage.systemSeconds = (double)(((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime) / 1e7;
+    }
+    else {
+        usage.cpuTime = false;
+    }
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        usage.peakMemory = counters.PeakWorkingSetSize;
+    }
+#else
+    (void)perThread;
+    usage.cpuTime = false;
+#endif
+    return usage;
+}
+
+struct t_stats {
+    //Counters of the input, indexed by segment type
+    size_t segments[256] = {};
+    size_t bytes[256]    = {};
+    size_t displaySets   = 0;
+    size_t epochs        = 0;
+    size_t modified[OPERATIONS] = {}; //segments changed by each operation
+
+    double phaseSeconds[PHASES] = {};
+    bool   timing = false;
+    int    phase  = PHASES; //phase being timed, PHASES if none
+    std::chrono::steady_clock::time_point phaseStart;
+
+    //Filled by the job at the end
+    double elapsedSeconds  = 0;
+    size_t outputBytes     = 0;
+    size_t damagedSpans    = 0;
+    size_t droppedSegments = 0;
+    t_resourceUsage usage  = {};
+
+    void enter(e_statsPhase phase);
+    void stop();
+    void merge(const t_stats& other);
+    size_t inputBytes() const;
+};
+
+void t_stats::enter(e_statsPhase phase) {
+    if (!timing) {
+        return;
+    }
+    stop();
+    this->phase = phase;
+}
+
+void t_stats::stop() {
+    if (!timing) {
+        return;
+    }
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (phase != PHASES) {
+        phaseSeconds[phase] += std::chrono::duration<double>(now - phaseStart).count();
+    }
+    phase = PHASES;
+    phaseStart = now;
+}
+
+//Add the counters and the phase times of a part of the stream processed on another thread
+void t_stats::merge(const t_stats& other) {
+    for (int i = 0; i < 256; i++) {
+        segments[i] += other.segments[i];
+        bytes[i]    += other.bytes[i];
+    }
+    displaySets += other.displaySets;
+    epochs      += other.epochs;
+    for (int i = 0; i < OPERATIONS; i++) {
+        modified[i] += other.modified[i];
+    }
+    for (int i = 0; i < PHASES; i++) {
+        phaseSeconds[i] += other.phaseSeconds[i];
+    }
+}
+
+size_t t_stats::inputBytes() const {
+    size_t total = 0;
+    for (int i = 0; i < 256; i++) {
+        total += bytes[i];
+    }
+    return total;
+}
+
+//Operations selected on the command line, only their counters are reported
+bool statsOperationActive(const t_cmd& cmd, int operation) {
+    switch (operation) {
+        case operationDelay:    return cmd.delay != 0;
+        case operationResync:   return cmd.resync != 1;
+        case operationMove:     return cmd.move.deltaX != 0 || cmd.move.deltaY != 0;
+        case operationCrop:     return (cmd.crop.left + cmd.crop.top + cmd.crop.right + cmd.crop.bottom) > 0;
+        case operationTonemap:  return cmd.tonemap != 1;
+        case operationAddZero:  return cmd.addZero;
+        case operationCutMerge: return cmd.cutMerge.doCutMerge;
+    }
+    return false;
+}
+
+void appendFormat(std::string& out, const char* format, ...) {
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out += line;
+}
+
+//The report is built whole and written with a single call, so the jobs of a batch do not mix theirs
+std::string formatStats(const t_cmd& cmd, const t_stats& stats) {
+    static const uint8_t types[5] = { e_segmentType::pcs, e_segmentType::wds, e_segmentType::pds, e_segmentType::ods, e_segmentType::end };
+    static const char* const typeNames[5] = { "PCS", "WDS", "PDS", "ODS", "END" };
+
+    size_t otherSegments = 0;
+    size_t otherBytes = 0;
+    for (int i = 0; i < 256; i++) {
+        if (!isSegmentType((uint8_t)i)) {
+            otherSegments += stats.segments[i];
+            otherBytes += stats.bytes[i];
+        }
+    }
+
+    double inputMiB = (double)stats.inputBytes() / (1024.0 * 1024.0);
+    double throughput = stats.elapsedSeconds > 0 ? inputMiB / stats.elapsedSeconds : 0;
+    std::string out;
+
+    if (cmd.statsFormat == e_statsFormat::json) {
+        std::string file;
+        for (const char* c = cmd.inputFile; *c != '\0'; c++) {
+            if (*c == '"' || *c == '\\') {
+                file += '\\';
+            }
+            if ((unsigned char)*c >= 0x20) {
+                file += *c;
+            }
+        }
+
+        out += "{\"file\":\"" + file + "\",\"wall_ms\":{";
+        for (int i = 0; i < PHASES; i++) {
+            appendFormat(out, "\"%s\":%.3f,", statsPhaseNames[i], stats.phaseSeconds[i] * 1000);
+        }
+        appendFormat(out, "\"total\":%.3f},", stats.elapsedSeconds * 1000);
+        if (stats.usage.cpuTime) {
+            appendFormat(out, "\"cpu_ms\":{\"user\":%.3f,\"system\":%.3f},", stats.usage.userSeconds * 1000, stats.usage.systemSeconds * 1000);
+        }
+        else {
+            out += "\"cpu_ms\":null,";
+        }
+        out += "\"segments\":{";
+        for (int i = 0; i < 5; i++) {
+            appendFormat(out, "\"%s\":{\"count\":%zu,\"bytes\":%zu},", typeNames[i], stats.segments[types[i]], stats.bytes[types[i]]);
+        }
+        appendFormat(out, "\"other\":{\"count\":%zu,\"bytes\":%zu}},\"display_sets\":%zu,\"epochs\":%zu,\"modified\":{",
+                     otherSegments, otherBytes, stats.displaySets, stats.epochs);
+        bool first = true;
+        for (int i = 0; i < OPERATIONS; i++) {
+            if (!statsOperationActive(cmd, i)) continue;
+            appendFormat(out, "%s\"%s\":%zu", first ? "" : ",", statsOperationNames[i], stats.modified[i]);
+            first = false;
+        }
+        appendFormat(out, "},\"damaged_spans\":%zu,\"dropped_segments\":%zu,\"input_bytes\":%zu,\"output_bytes\":%zu,\"mib_per_second\":%.1f,\"peak_memory_bytes\":%zu}\n",
+                     stats.damagedSpans, stats.droppedSegments, stats.inputBytes(), stats.outputBytes, throughput, stats.usage.peakMemory);
+        return out;
+    }
+
+    out += "Stats of " + std::string(cmd.inputFile) + "\n";
+    appendFormat(out, "  Phase          wall ms\n");
+    for (int i = 0; i < PHASES; i++) {
+        appendFormat(out, "    %-10s %10.3f\n", statsPhaseNames[i], stats.phaseSeconds[i] * 1000);
+    }
+    if (stats.usage.cpuTime) {
+        appendFormat(out, "    %-10s %10.3f    CPU user %.3f ms, system %.3f ms\n", "total",
+                     stats.elapsedSeconds * 1000, stats.usage.userSeconds * 1000, stats.usage.systemSeconds * 1000);
+    }
+    else {
+        appendFormat(out, "    %-10s %10.3f    CPU time not available\n", "total", stats.elapsedSeconds * 1000);
+    }
+    appendFormat(out, "  Segment          count           bytes\n");
+    for (int i = 0; i < 5; i++) {
+        appendFormat(out, "    %-6s %12zu %15zu\n", typeNames[i], stats.segments[types[i]], stats.bytes[types[i]]);
+    }
+    if (otherSegments != 0) {
+        appendFormat(out, "    %-6s %12zu %15zu\n", "other", otherSegments, otherBytes);
+    }
+    appendFormat(out, "  Display sets %zu, epochs %zu\n", stats.displaySets, stats.epochs);
+    for (int i = 0; i < OPERATIONS; i++) {
+        if (!statsOperationActive(cmd, i)) continue;
+        appendFormat(out, "  Segments modified by %s: %zu\n", statsOperationNames[i], stats.modified[i]);
+    }
+    if (stats.damagedSpans != 0) {
+        appendFormat(out, "  Damaged parts %zu, dropped segments %zu\n", stats.damagedSpans, stats.droppedSegments);
+    }
+    appendFormat(out, "  Input %.2f MiB, output %.2f MiB, %.1f MiB/s\n", inputMiB, (double)stats.outputBytes / (1024.0 * 1024.0), throughput);
+    appendFormat(out, "  Peak memory %zu KiB\n", stats.usage.peakMemory / 1024);
+
+    return out;
+}
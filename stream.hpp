@@ -0,0 +1,700 @@
+//A display set is read in a single reusable buffer, from its PCS up to and including its END segment,
+//so the memory used only depends on the biggest display set of the stream and not on the file size.
+//
+//On POSIX systems the input is memory mapped when possible: headers and the bodies the job modifies
+//(by default PCS/WDS/PDS, the only ones that can be) are still copied in the buffer, while the other
+//bodies are only referenced inside the mapping and written back with writev (or copy_file_range on
+//Linux) without being copied.
+//
+//The input can also be a buffer in memory, read through the same path as a mapped file, and the
+//output a callback, so the library can process streams without touching the disk.
+//
+//Pipes are read with fread one display set at a time, as it arrives. They cannot seek, so in recovery
+//mode the search of the next PCS reads ahead and keeps what it read in a lookahead buffer. The read
+//callback of the library takes the same path.
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SUPMOVER_MMAP
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+//fseek and ftell with 64 bit offsets, long is 32 bit on Windows
+int seekFile(FILE* file, int64_t offset, int origin) {
+#ifdef _WIN32
+    return _fseeki64(file, offset, origin);
+#else
+    return fseeko(file, (off_t)offset, origin);
+#endif
+}
+
+int64_t tellFile(FILE* file) {
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return (int64_t)ftello(file);
+#endif
+}
+
+struct t_segment {
+    t_header       header;
+    size_t         start;          //offset of the segment header inside the display set buffer
+    size_t         offset;         //offset of the segment header inside the input file
+    const uint8_t* data = nullptr; //segment body inside the input mapping, if not copied in the buffer
+};
+
+struct t_displaySet {
+    size_t offset; //offset of the display set inside the input file
+    std::vector<uint8_t>   buffer;
+    std::vector<t_segment> segments;
+    bool mapped = false; //at least one segment body is only referenced inside the input mapping
+
+    void clear();
+    uint8_t* body(t_segment& segment);
+    void replaceSegments(size_t first, size_t last, const std::vector<uint8_t>& replacement);
+};
+
+void t_displaySet::clear() {
+    buffer.clear();
+    segments.clear();
+    offset = 0;
+    mapped = false;
+}
+
+uint8_t* t_displaySet::body(t_segment& segment) {
+    if (segment.data != nullptr) {
+        return (uint8_t*)segment.data;
+    }
+
+    return &buffer[segment.start + HEADER_SIZE];
+}
+
+//Replace the segments from first to last (included) with the ones contained in replacement,
+//the display set buffer is rebuilt so this should only be used for the few modified display sets
+void t_displaySet::replaceSegments(size_t first, size_t last, const std::vector<uint8_t>& replacement) {
+    std::vector<uint8_t>   newBuffer;
+    std::vector<t_segment> newSegments;
+    newBuffer.reserve(buffer.size() + replacement.size());
+    mapped = false;
+
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (i == first) {
+            size_t pos = 0;
+            while (pos + HEADER_SIZE <= replacement.size()) {
+                t_header header = t_header::read((uint8_t*)&replacement[pos]);
+                newSegments.push_back({ header, newBuffer.size() + pos, segments[first].offset });
+                pos += HEADER_SIZE + header.dataLength;
+            }
+            newBuffer.insert(newBuffer.end(), replacement.begin(), replacement.end());
+            i = last;
+            continue;
+        }
+
+        t_segment segment = segments[i];
+        size_t length = HEADER_SIZE + (segment.data == nullptr ? segment.header.dataLength : 0);
+        newBuffer.insert(newBuffer.end(), &buffer[segment.start], &buffer[segment.start + length]);
+        segment.start = newBuffer.size() - length;
+        newSegments.push_back(segment);
+        mapped = mapped || segment.data != nullptr;
+    }
+
+    buffer.swap(newBuffer);
+    segments.swap(newSegments);
+}
+
+
+//Part of the input dropped in recovery mode, from the beginning of the display set containing the
+//damaged data up to the next valid PCS
+struct t_damagedSpan {
+    size_t begin;
+    size_t damage; //offset of the first segment found not valid
+    size_t end;
+    size_t droppedSegments;
+};
+
+struct t_supReader {
+    FILE*  file     = nullptr;
+    size_t position = 0;
+    size_t end      = SIZE_MAX; //reading stops at this offset, used to read only a part of the input
+    bool   error    = false;
+    bool   recover  = false;    //skip the damaged parts of the stream instead of aborting
+    bool   seekable = true;     //false for pipes, they are only read forward
+    const bool* copyBody = nullptr; //segment types whose body is copied from the mapping, all but ODS if null
+    std::vector<t_damagedSpan> damagedSpans;
+
+    const uint8_t* map     = nullptr;
+    size_t         mapSize = 0;
+    bool           ownsMap = false; //map was created by mapInput, not set with setBuffer
+
+    //Input read from a pipe but not consumed yet, from lookaheadPos on
+    std::vector<uint8_t> lookahead;
+    size_t               lookaheadPos = 0;
+
+    //Input read through a callback instead of file, it returns the number of bytes read like fread and 0 at the end
+    size_t (*callback)(void* opaque, uint8_t* data, size_t size) = nullptr;
+    void*  opaque = nullptr;
+
+    bool mapInput();
+    void setBuffer(const uint8_t* data, size_t size);
+    void unmapInput();
+    bool read(t_displaySet& ds);
+    bool readMapped(t_displaySet& ds);
+    size_t readInput(uint8_t* data, size_t size);
+    size_t readFile(uint8_t* data, size_t size);
+    size_t peek(uint8_t* data, size_t size);
+    void unread(const uint8_t* data, size_t size);
+    bool damaged(t_displaySet& ds, const char* message);
+    size_t findNextPCS(size_t from);
+    size_t findNextPCSForward(size_t from);
+    void seek(size_t offset);
+    void rewind();
+};
+
+bool isSegmentType(uint8_t type) {
+    return type == e_segmentType::pds || type == e_segmentType::ods || type == e_segmentType::pcs
+        || type == e_segmentType::wds || type == e_segmentType::end;
+}
+
+bool isValidHeader(const uint8_t* data, size_t size, size_t pos) {
+    return size >= HEADER_SIZE && pos <= size - HEADER_SIZE
+        && data[pos] == 'P' && data[pos + 1] == 'G'
+        && isSegmentType(data[pos + 10]);
+}
+
+//Offset of the first PCS in data[from, limit) whose data length chains to another valid header (or
+//exactly to the end of the stream if atEnd), SIZE_MAX if none is found. Data must extend past limit
+//for at least a segment and a header, unless atEnd. The magic is searched with memchr, which the
+//C libraries implement with vector instructions.
+size_t findValidPCS(const uint8_t* data, size_t size, size_t from, size_t limit, bool atEnd) {
+    size_t pos = from;
+
+    while (pos < limit) {
+        const uint8_t* found = (const uint8_t*)std::memchr(&data[pos], 'P', limit - pos);
+        if (found == nullptr) {
+            break;
+        }
+        pos = found - data;
+
+        if (isValidHeader(data, size, pos) && data[pos + 10] == e_segmentType::pcs) {
+            size_t next = pos + HEADER_SIZE + t_header::read((uint8_t*)&data[pos]).dataLength;
+            if ((atEnd && next == size) || isValidHeader(data, size, next)) {
+                return pos;
+            }
+        }
+        pos++;
+    }
+
+    return SIZE_MAX;
+}
+
+//Try to map the whole input file, on failure (or on unsupported platforms) the input is read with fread
+bool t_supReader::mapInput() {
+#ifdef SUPMOVER_MMAP
+    int fd = fileno(file);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        return false;
+    }
+
+    void* addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    map     = (const uint8_t*)addr;
+    mapSize = (size_t)st.st_size;
+    ownsMap = true;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+//Read the input from a buffer owned by the caller, which must stay valid until unmapInput
+void t_supReader::setBuffer(const uint8_t* data, size_t size) {
+    map     = data;
+    mapSize = size;
+    ownsMap = false;
+}
+
+void t_supReader::unmapInput() {
+#ifdef SUPMOVER_MMAP
+    if (map != nullptr && ownsMap) {
+        munmap((void*)map, mapSize);
+    }
+#endif
+    map     = nullptr;
+    mapSize = 0;
+    ownsMap = false;
+}
+
+//Read the next display set, return false at the end of the stream or if an error is found
+bool t_supReader::read(t_displaySet& ds) {
+    ds.clear();
+    ds.offset = position;
+
+    if (error) {
+        return false;
+    }
+
+    if (map != nullptr) {
+        return readMapped(ds);
+    }
+
+    while (position < end) {
+        size_t start = ds.buffer.size();
+        ds.buffer.resize(start + HEADER_SIZE);
+
+        size_t bytesRead = readInput(&ds.buffer[start], HEADER_SIZE);
+        if (bytesRead == 0) {
+            ds.buffer.resize(start);
+            break;
+        }
+        if (bytesRead != HEADER_SIZE) {
+            unread(&ds.buffer[start], bytesRead);
+            if (!damaged(ds, "Truncated segment")) return false;
+            continue;
+        }
+
+        t_header header = t_header::read(&ds.buffer[start]);
+        if (header.header != 0x5047 || (recover && !isSegmentType(header.segmentType))) {
+            unread(&ds.buffer[start], HEADER_SIZE);
+            if (!damaged(ds, "Correct header not found")) return false;
+            continue;
+        }
+
+        ds.buffer.resize(start + HEADER_SIZE + header.dataLength);
+        bytesRead = readInput(&ds.buffer[start + HEADER_SIZE], header.dataLength);
+        if (bytesRead != header.dataLength) {
+            unread(&ds.buffer[start], HEADER_SIZE + bytesRead);
+            if (!damaged(ds, "Truncated segment")) return false;
+            continue;
+        }
+
+        ds.segments.push_back({ header, start, position });
+        position += HEADER_SIZE + header.dataLength;
+
+        if (header.segmentType == e_segmentType::end) {
+            break;
+        }
+    }
+
+    return !ds.segments.empty();
+}
+
+//Read from the lookahead first, then from the file
+size_t t_supReader::readInput(uint8_t* data, size_t size) {
+    size_t copied = 0;
+    if (lookaheadPos < lookahead.size()) {
+        copied = std::min(size, lookahead.size() - lookaheadPos);
+        std::memcpy(data, &lookahead[lookaheadPos], copied);
+        lookaheadPos += copied;
+        if (lookaheadPos == lookahead.size()) {
+            lookahead.clear();
+            lookaheadPos = 0;
+        }
+    }
+    if (copied < size) {
+        copied += readFile(data + copied, size - copied);
+    }
+
+    return copied;
+}
+
+//The callback can return less than size before the end, like a pipe read with read
+size_t t_supReader::readFile(uint8_t* data, size_t size) {
+    if (callback == nullptr) {
+        return std::fread(data, 1, size, file);
+    }
+
+    size_t total = 0;
+    while (total < size) {
+        size_t bytesRead = callback(opaque, data + total, size - total);
+        if (bytesRead == 0) {
+            break;
+        }
+        total += std::min(bytesRead, size - total);
+    }
+
+    return total;
+}
+
+//Read the next bytes without consuming them, used to recognize the container of the input
+size_t t_supReader::peek(uint8_t* data, size_t size) {
+    if (map != nullptr) {
+        size = std::min(size, mapSize - std::min(position, mapSize));
+        std::memcpy(data, &map[position], size);
+        return size;
+    }
+
+    size_t bytesRead = readInput(data, size);
+    if (seekable) {
+        seekFile(file, (int64_t)position, SEEK_SET);
+    }
+    else {
+        unread(data, bytesRead);
+    }
+
+    return bytesRead;
+}
+
+//Give back to a pipe the bytes of a damaged segment, the search of the next PCS starts inside them.
+//A seekable file is positioned again by seek instead.
+void t_supReader::unread(const uint8_t* data, size_t size) {
+    if (seekable || size == 0) {
+        return;
+    }
+    lookahead.insert(lookahead.begin() + lookaheadPos, data, data + size);
+}
+
+bool t_supReader::readMapped(t_displaySet& ds) {
+    while (position < std::min(end, mapSize)) {
+        if (mapSize - position < HEADER_SIZE) {
+            if (!damaged(ds, "Truncated segment")) return false;
+            continue;
+        }
+
+        t_header header = t_header::read((uint8_t*)&map[position]);
+        if (header.header != 0x5047 || (recover && !isSegmentType(header.segmentType))) {
+            if (!damaged(ds, "Correct header not found")) return false;
+            continue;
+        }
+        if (mapSize - position - HEADER_SIZE < header.dataLength) {
+            if (!damaged(ds, "Truncated segment")) return false;
+            continue;
+        }
+
+        size_t start = ds.buffer.size();
+        ds.buffer.insert(ds.buffer.end(), &map[position], &map[position + HEADER_SIZE]);
+
+        const uint8_t* data = &map[position + HEADER_SIZE];
+        bool copy = copyBody != nullptr ? copyBody[header.segmentType] : header.segmentType != e_segmentType::ods;
+        if (!copy) {
+            ds.segments.push_back({ header, start, position, data });
+            ds.mapped = true;
+        }
+        else {
+            ds.buffer.insert(ds.buffer.end(), data, data + header.dataLength);
+            ds.segments.push_back({ header, start, position });
+        }
+        position += HEADER_SIZE + header.dataLength;
+
+        if (header.segmentType == e_segmentType::end) {
+            break;
+        }
+    }
+
+    return !ds.segments.empty();
+}
+
+size_t const RESYNC_CHUNK_SIZE = 1024 * 1024;
+size_t const RESYNC_LOOKAHEAD  = 2 * HEADER_SIZE + UINT16_MAX; //a whole segment and the next header
+
+//Handle a damaged segment at the current position: abort, or in recovery mode drop the display set
+//being read and continue from the next valid PCS. Return false if the reading must stop.
+bool t_supReader::damaged(t_displaySet& ds, const char* message) {
+    if (!recover) {
+        std::fprintf(stderr, "%s at position %zd, abort!\n", message, position);
+        error = true;
+        return false;
+    }
+
+    size_t resume = findNextPCS(position + 1);
+    damagedSpans.push_back({ ds.offset, position, resume, ds.segments.size() });
+
+    ds.clear();
+    seek(resume);
+    ds.offset = resume;
+
+    return true;
+}
+
+//Offset of the next valid PCS starting from offset from, or the end of the input if there is none
+size_t t_supReader::findNextPCS(size_t from) {
+    if (map != nullptr) {
+        size_t found = findValidPCS(map, mapSize, std::min(from, mapSize), mapSize, true);
+        return found != SIZE_MAX ? found : mapSize;
+    }
+    if (!seekable) {
+        return findNextPCSForward(from);
+    }
+
+    std::vector<uint8_t> window(RESYNC_CHUNK_SIZE + RESYNC_LOOKAHEAD);
+    size_t base = from;
+    while (true) {
+        seekFile(file, (int64_t)base, SEEK_SET);
+        size_t size = std::fread(window.data(), 1, window.size(), file);
+        bool atEnd = size < window.size();
+
+        size_t found = findValidPCS(window.data(), size, 0, atEnd ? size : RESYNC_CHUNK_SIZE, atEnd);
+        if (found != SIZE_MAX) {
+            return base + found;
+        }
+        if (atEnd) {
+            return base + size;
+        }
+        base += RESYNC_CHUNK_SIZE;
+    }
+}
+
+//Same search on a pipe, the lookahead holds the input from position on. What follows the PCS found is
+//left in the lookahead, so the next read starts from it.
+size_t t_supReader::findNextPCSForward(size_t from) {
+    lookahead.erase(lookahead.begin(), lookahead.begin() + lookaheadPos);
+    lookaheadPos = 0;
+
+    size_t skip = std::min(from - position, lookahead.size());
+    lookahead.erase(lookahead.begin(), lookahead.begin() + skip);
+    size_t base = position + skip;
+
+    while (true) {
+        size_t size = lookahead.size();
+        lookahead.resize(RESYNC_CHUNK_SIZE + RESYNC_LOOKAHEAD);
+        if (size < lookahead.size()) {
+            size += readFile(&lookahead[size], lookahead.size() - size);
+        }
+        bool atEnd = size < lookahead.size();
+        lookahead.resize(size);
+
+        size_t found = findValidPCS(lookahead.data(), size, 0, atEnd ? size : RESYNC_CHUNK_SIZE, atEnd);
+        if (found != SIZE_MAX) {
+            lookahead.erase(lookahead.begin(), lookahead.begin() + found);
+            return base + found;
+        }
+        if (atEnd) {
+            lookahead.clear();
+            return base + size;
+        }
+        lookahead.erase(lookahead.begin(), lookahead.begin() + RESYNC_CHUNK_SIZE);
+        base += RESYNC_CHUNK_SIZE;
+    }
+}
+
+void t_supReader::seek(size_t offset) {
+    if (map == nullptr && seekable) {
+        seekFile(file, (int64_t)offset, SEEK_SET);
+    }
+    position = offset;
+    error = false;
+}
+
+void t_supReader::rewind() {
+    seek(0);
+}
+
+
+struct t_supWriter {
+    FILE* file  = nullptr;
+    bool  error = false;
+
+    //Output through a callback instead of file, it returns the number of bytes written like fwrite
+    size_t (*callback)(void* opaque, const uint8_t* data, size_t size) = nullptr;
+    void*  opaque = nullptr;
+    bool   flush  = false; //flush every display set, so the program reading a pipe gets it immediately
+
+    //Input file used as source of copy_file_range for the segments still inside the mapping
+    const t_supReader* source = nullptr;
+    bool copyRange = true;
+
+    void write(t_displaySet& ds);
+    void writeBytes(const uint8_t* data, size_t size);
+    void writeParts(t_displaySet& ds);
+#ifdef SUPMOVER_MMAP
+    void writeSpans(t_displaySet& ds);
+    bool writeIov(std::vector<struct iovec>& iov);
+    bool copyMapped(const uint8_t* data, size_t length);
+#endif
+};
+
+void t_supWriter::write(t_displaySet& ds) {
+    if (ds.buffer.empty()) {
+        return;
+    }
+
+    if (callback != nullptr) {
+        writeParts(ds);
+        return;
+    }
+
+#ifdef SUPMOVER_MMAP
+    if (ds.mapped) {
+        writeSpans(ds);
+        return;
+    }
+#endif
+
+    //Without a mapping the bodies of a buffer set with setBuffer are still only referenced
+    writeParts(ds);
+    if (flush && std::fflush(file) != 0) {
+        error = true;
+    }
+}
+
+void t_supWriter::writeBytes(const uint8_t* data, size_t size) {
+    if (error || size == 0) {
+        return;
+    }
+
+    if (callback != nullptr) {
+        error = callback(opaque, data, size) != size;
+    }
+    else {
+        error = std::fwrite(data, size, 1, file) != 1;
+    }
+}
+
+//Write the copied parts of the buffer, merged while contiguous, and the bodies still inside the input
+//buffer, without gathering them
+void t_supWriter::writeParts(t_displaySet& ds) {
+    if (!ds.mapped) {
+        writeBytes(ds.buffer.data(), ds.buffer.size());
+        return;
+    }
+
+    size_t spanStart = 0;
+    size_t spanEnd   = 0;
+    for (t_segment& segment : ds.segments) {
+        size_t length = HEADER_SIZE;
+        if (segment.data == nullptr) {
+            length += segment.header.dataLength;
+        }
+
+        if (segment.start != spanEnd) {
+            writeBytes(ds.buffer.data() + spanStart, spanEnd - spanStart);
+            spanStart = segment.start;
+        }
+        spanEnd = segment.start + length;
+
+        if (segment.data != nullptr) {
+            writeBytes(ds.buffer.data() + spanStart, spanEnd - spanStart);
+            writeBytes(segment.data, segment.header.dataLength);
+            spanStart = spanEnd;
+        }
+    }
+    writeBytes(ds.buffer.data() + spanStart, spanEnd - spanStart);
+}
+
+#ifdef SUPMOVER_MMAP
+size_t const COPY_RANGE_MIN_SIZE = 32 * 1024; //smaller bodies are cheaper to gather in a single writev
+
+//Write the display set as a list of spans, the copied parts of the buffer and the ODS bodies
+//still inside the mapping, without gathering them in a single buffer
+void t_supWriter::writeSpans(t_displaySet& ds) {
+    std::vector<struct iovec> iov;
+    iov.reserve(ds.segments.size() * 2);
+
+    //Everything written through stdio (e.g. the --add_zero display set) must come first
+    std::fflush(file);
+
+    for (t_segment& segment : ds.segments) {
+        size_t length = HEADER_SIZE;
+        if (segment.data == nullptr) {
+            length += segment.header.dataLength;
+        }
+
+        uint8_t* copied = &ds.buffer[segment.start];
+        if (!iov.empty() && (uint8_t*)iov.back().iov_base + iov.back().iov_len == copied) {
+            iov.back().iov_len += length;
+        }
+        else {
+            iov.push_back({ copied, length });
+        }
+
+        if (segment.data != nullptr && segment.header.dataLength > 0) {
+            if (copyRange && segment.header.dataLength >= COPY_RANGE_MIN_SIZE) {
+                if (!writeIov(iov)) {
+                    return;
+                }
+                iov.clear();
+
+                if (copyMapped(segment.data, segment.header.dataLength)) {
+                    continue;
+                }
+                if (error) {
+                    return;
+                }
+            }
+            iov.push_back({ (void*)segment.data, segment.header.dataLength });
+        }
+    }
+
+    writeIov(iov);
+}
+
+bool t_supWriter::writeIov(std::vector<struct iovec>& iov) {
+    int fd = fileno(file);
+    size_t idx = 0;
+
+    while (idx < iov.size()) {
+        int count = (int)std::min(iov.size() - idx, (size_t)IOV_MAX);
+        ssize_t written = writev(fd, &iov[idx], count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = true;
+            return false;
+        }
+
+        //Skip what was fully written and adjust the first partially written span
+        size_t remaining = (size_t)written;
+        while (idx < iov.size() && remaining >= iov[idx].iov_len) {
+            remaining -= iov[idx].iov_len;
+            idx++;
+        }
+        if (remaining > 0) {
+            iov[idx].iov_base = (uint8_t*)iov[idx].iov_base + remaining;
+            iov[idx].iov_len -= remaining;
+        }
+    }
+
+    return true;
+}
+
+//Let the kernel copy the data directly between the two files, return false if the data must be
+//written normally (copy_file_range not available or not supported between these two files)
+bool t_supWriter::copyMapped(const uint8_t* data, size_t length) {
+#if defined(__linux__)
+    if (source == nullptr || source->map == nullptr || !source->ownsMap) {
+        copyRange = false;
+        return false;
+    }
+
+    int inFd = fileno(source->file);
+    int outFd = fileno(file);
+    loff_t inOffset = data - source->map;
+    size_t remaining = length;
+
+    while (remaining > 0) {
+        ssize_t copied = copy_file_range(inFd, &inOffset, outFd, nullptr, remaining, 0);
+        if (copied <= 0) {
+            if (copied < 0 && errno == EINTR) {
+                continue;
+            }
+            if (remaining == length) {
+                copyRange = false;
+                return false;
+            }
+            //Part of the data was already copied, write the rest normally
+            std::vector<struct iovec> rest = { { (void*)(data + (length - remaining)), remaining } };
+            return writeIov(rest);
+        }
+        remaining -= (size_t)copied;
+    }
+
+    return true;
+#else
+    (void)data;
+    (void)length;
+    copyRange = false;
+    return false;
+#endif
+}
+#endif
@@ -0,0 +1,133 @@
+#include <iostream>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "pgs.hpp"
+#include "cmd.hpp"
+#include "stream.hpp"
+#include "palette.hpp"
+#include "rle.hpp"
+#include "generator.hpp"
+
+const char* usageHelp = R"(Usage:  SupGen <output.sup> [OPTIONS ...]
+
+OPTIONS:
+  --events <n>                 display set pairs, one showing the objects and one clearing them
+  --video <width>x<height>
+  --objects <n>                objects and windows of each event (1-64)
+  --object_size <width>x<height>
+  --palettes <n>               palette entries (1-255)
+  --epoch <n>                  events of an epoch
+  --duration <ms>
+  --interval <ms>
+  --cropped
+  --forced
+  --seed <n>
+
+Objects bigger than a segment are split in more ODS segments.
+)";
+
+bool parseSize(const char* str, uint16_t& width, uint16_t& height) {
+    unsigned int w, h;
+    if (std::sscanf(str, "%ux%u", &w, &h) != 2 || w == 0 || h == 0 || w > UINT16_MAX || h > UINT16_MAX) {
+        return false;
+    }
+    width = (uint16_t)w;
+    height = (uint16_t)h;
+
+    return true;
+}
+
+bool parseGeneratorCMD(int32_t argc, char** argv, t_generatorOptions& options) {
+    int i = 2;
+
+    while (i < argc) {
+        std::string arg = argv[i++];
+        int remaining = argc - i;
+
+        if (arg == "events" || arg == "--events") {
+            if (remaining < 1) return false;
+            options.events = (size_t)std::strtoull(argv[i++], nullptr, 10);
+        }
+        else if (arg == "video" || arg == "--video") {
+            if (remaining < 1) return false;
+            if (!parseSize(argv[i++], options.videoWidth, options.videoHeight)) return false;
+        }
+        else if (arg == "objects" || arg == "--objects") {
+            if (remaining < 1) return false;
+            options.objects = (uint8_t)std::min(255, std::max(0, std::atoi(argv[i++])));
+        }
+        else if (arg == "object_size" || arg == "--object_size") {
+            if (remaining < 1) return false;
+            if (!parseSize(argv[i++], options.objectWidth, options.objectHeight)) return false;
+        }
+        else if (arg == "palettes" || arg == "--palettes") {
+            if (remaining < 1) return false;
+            options.palettes = (uint8_t)std::min(255, std::max(0, std::atoi(argv[i++])));
+        }
+        else if (arg == "epoch" || arg == "--epoch") {
+            if (remaining < 1) return false;
+            options.epoch = (size_t)std::strtoull(argv[i++], nullptr, 10);
+        }
+        else if (arg == "duration" || arg == "--duration") {
+            if (remaining < 1) return false;
+            options.duration = (uint32_t)std::strtoul(argv[i++], nullptr, 10);
+        }
+        else if (arg == "interval" || arg == "--interval") {
+            if (remaining < 1) return false;
+            options.interval = (uint32_t)std::strtoul(argv[i++], nullptr, 10);
+        }
+        else if (arg == "cropped" || arg == "--cropped") {
+            options.cropped = true;
+        }
+        else if (arg == "forced" || arg == "--forced") {
+            options.forced = true;
+        }
+        else if (arg == "seed" || arg == "--seed") {
+            if (remaining < 1) return false;
+            options.seed = (uint32_t)std::strtoul(argv[i++], nullptr, 10);
+        }
+        else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int32_t argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "%s", usageHelp);
+        return -1;
+    }
+
+    t_generatorOptions options = {};
+    if (!parseGeneratorCMD(argc, argv, options)) {
+        std::fprintf(stderr, "Error parsing input\n");
+        return -1;
+    }
+
+    FILE* output = std::fopen(argv[1], "wb");
+    if (output == nullptr) {
+        std::fprintf(stderr, "Unable to open output file!\n");
+        return -1;
+    }
+
+    t_streamInfo info = {};
+    bool generated = generateStream(options, output, info);
+    if (std::fclose(output) != 0 || !generated) {
+        std::fprintf(stderr, "Unable to generate output file!\n");
+        return -1;
+    }
+    std::printf("%zu display sets, %zu segments, %zu bytes\n", info.displaySets, info.segments, info.bytes);
+
+    return 0;
+}
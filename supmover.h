@@ -0,0 +1,142 @@
+/*
+ * libsupmover: the SupMover engine as a library, processing a PGS stream in memory.
+ *
+ * The input is a buffer or a read callback, the output a caller provided buffer or a write callback,
+ * so a stream can be processed without temporary files or spawning the executable. The options are
+ * the ones of the command line, warnings and errors are still printed on stderr.
+ *
+ * Build with "make lib" (libsupmover.a and libsupmover.so), the C++ API at the end of this file is
+ * header only and built on top of the C one.
+ */
+
+#ifndef SUPMOVER_H
+#define SUPMOVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Only the API is exported from the shared library, the engine is built with hidden visibility */
+#if defined(__GNUC__)
+#define SUPMOVER_API __attribute__((visibility("default")))
+#else
+#define SUPMOVER_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SUPMOVER_OK                0
+#define SUPMOVER_ERROR            -1
+#define SUPMOVER_BUFFER_TOO_SMALL -2 /* the required size is returned in output_size */
+
+/* Same values of --format and --timemode, the ones of --fixmode are only those of this API */
+enum {
+    SUPMOVER_FORMAT_SECUT       = 0,
+    SUPMOVER_FORMAT_VAPOURSYNTH = 1,
+    SUPMOVER_FORMAT_AVISYNTH    = 2,
+    SUPMOVER_FORMAT_REMAP       = 3
+};
+
+enum {
+    SUPMOVER_TIMEMODE_MS        = 0,
+    SUPMOVER_TIMEMODE_FRAME     = 1,
+    SUPMOVER_TIMEMODE_TIMESTAMP = 2
+};
+
+enum {
+    SUPMOVER_FIXMODE_CUT    = 0,
+    SUPMOVER_FIXMODE_DELETE = 1
+};
+
+/* Options of a job, initialize them with supmover_default_options */
+typedef struct supmover_options {
+    double   delay_ms;    /* added after the resync */
+    double   resync;      /* 1 to keep the timestamps */
+    int16_t  move_x;
+    int16_t  move_y;
+    uint16_t crop_left;
+    uint16_t crop_top;
+    uint16_t crop_right;
+    uint16_t crop_bottom;
+    double   tonemap;     /* 1 to keep the palettes */
+    int      add_zero;
+    int      recover;
+    uint32_t threads;
+
+    const char* cut_merge_list; /* NULL to disable Cut&Merge */
+    int      cut_merge_format;
+    int      cut_merge_time_mode;
+    double   cut_merge_fps;     /* only for SUPMOVER_TIMEMODE_FRAME */
+    int      cut_merge_fix_mode;
+} supmover_options;
+
+/* Return the number of bytes read or written, like fread and fwrite. Reading returns 0 at the end
+   of the input, writing less than size bytes aborts the job. */
+typedef size_t (*supmover_read_fn)(void* opaque, uint8_t* data, size_t size);
+typedef size_t (*supmover_write_fn)(void* opaque, const uint8_t* data, size_t size);
+
+SUPMOVER_API void supmover_default_options(supmover_options* options);
+
+/* Process input and pass the result to write, the input buffer must stay valid until the return */
+SUPMOVER_API int supmover_process(const supmover_options* options,
+                                  const uint8_t* input, size_t input_size,
+                                  supmover_write_fn write, void* write_opaque);
+
+/* Process input and write the result in output, output_size is set to the size of the result even
+   when it does not fit output_capacity */
+SUPMOVER_API int supmover_process_buffer(const supmover_options* options,
+                                         const uint8_t* input, size_t input_size,
+                                         uint8_t* output, size_t output_capacity, size_t* output_size);
+
+/* Process the input returned by read and pass the result to write, the input is read one display set
+   at a time as from a pipe, so it is never held whole in memory */
+SUPMOVER_API int supmover_process_callback(const supmover_options* options,
+                                           supmover_read_fn read, void* read_opaque,
+                                           supmover_write_fn write, void* write_opaque);
+
+#ifdef __cplusplus
+}
+
+#include <functional>
+#include <vector>
+
+/* C++ API, the callbacks must not throw */
+typedef std::function<size_t(uint8_t* data, size_t size)>       t_supmoverRead;
+typedef std::function<bool(const uint8_t* data, size_t size)>   t_supmoverWrite;
+
+inline supmover_options supmoverDefaultOptions() {
+    supmover_options options;
+    supmover_default_options(&options);
+    return options;
+}
+
+inline int supmoverProcess(const supmover_options& options, const uint8_t* input, size_t size, const t_supmoverWrite& write) {
+    supmover_write_fn callback = [](void* opaque, const uint8_t* data, size_t size) -> size_t {
+        return (*(const t_supmoverWrite*)opaque)(data, size) ? size : 0;
+    };
+    return supmover_process(&options, input, size, callback, (void*)&write);
+}
+
+inline int supmoverProcess(const supmover_options& options, const uint8_t* input, size_t size, std::vector<uint8_t>& output) {
+    output.clear();
+    output.reserve(size);
+    return supmoverProcess(options, input, size, [&output](const uint8_t* data, size_t size) {
+        output.insert(output.end(), data, data + size);
+        return true;
+    });
+}
+
+inline int supmoverProcess(const supmover_options& options, const t_supmoverRead& read, const t_supmoverWrite& write) {
+    supmover_read_fn readCallback = [](void* opaque, uint8_t* data, size_t size) -> size_t {
+        return (*(const t_supmoverRead*)opaque)(data, size);
+    };
+    supmover_write_fn writeCallback = [](void* opaque, const uint8_t* data, size_t size) -> size_t {
+        return (*(const t_supmoverWrite*)opaque)(data, size) ? size : 0;
+    };
+    return supmover_process_callback(&options, readCallback, (void*)&read, writeCallback, (void*)&write);
+}
+
+#endif
+
+#endif
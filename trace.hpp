@@ -0,0 +1,307 @@
+//Machine readable trace, one NDJSON or CSV record for each segment of the input as it is read, before
+//any modification. The records are formatted in a buffer written to the output in big blocks, so
+//the jobs of a batch never mix their records, and numbers are converted with to_chars instead of
+//parsing a format string for every value.
+
+size_t const TRACE_BUFFER_SIZE = 1 << 20;
+
+//Values of a record, CSV writes all of them in this order leaving empty the missing ones
+enum e_traceColumn : uint8_t {
+    columnOffset            = 0,
+    columnPTS               = 1,
+    columnDTS               = 2,
+    columnSize              = 3,
+    columnWidth             = 4,
+    columnHeight            = 5,
+    columnCompositionNumber = 6,
+    columnCompositionState  = 7,
+    columnPaletteUpdate     = 8,
+    columnPaletteID         = 9,
+    columnObjects           = 10,
+    columnWindows           = 11,
+    columnObjectID          = 12,
+    columnVersion           = 13,
+    columnSequenceFlag      = 14,
+    columnDataLength        = 15,
+    columnPaletteEntries    = 16,
+    TRACE_COLUMNS           = 17
+};
+
+const char* const traceColumnNames[TRACE_COLUMNS] = {
+    "offset", "pts", "dts", "size", "width", "height", "composition_number", "composition_state",
+    "palette_update", "palette_id", "objects", "windows", "object_id", "version", "sequence_flag",
+    "data_length", "palette_entries"
+};
+
+//Output of the traces, the CSV header is written once on it: the jobs of a batch share the standard
+//output and its header
+struct t_traceOutput {
+    FILE* file = nullptr;
+    std::atomic<bool> headerWritten{ false };
+};
+
+struct t_traceWriter {
+    FILE* file = nullptr;
+    e_traceFormat format = e_traceFormat::ndjson;
+    std::string buffer;
+    std::string fileName; //input file name, already quoted for the format
+    bool error = false;
+
+    int64_t value[TRACE_COLUMNS];
+    bool    present[TRACE_COLUMNS];
+    t_PCS   pcs = {};
+    t_WDS   wds = {};
+
+    void init(const t_cmd& cmd, t_traceOutput& output);
+    void segment(const t_segment& segment, uint8_t* body);
+    void flush();
+
+    void set(e_traceColumn column, int64_t value);
+    void appendNumber(int64_t value);
+    void appendField(const char* name, int64_t value);
+    void appendFlag(const char* name, bool value);
+    void appendType(uint8_t segmentType);
+    void appendCSV();
+    void appendNDJSON(uint8_t segmentType);
+};
+
+void t_traceWriter::init(const t_cmd& cmd, t_traceOutput& output) {
+    file = output.file;
+    format = cmd.traceFormat;
+    buffer.reserve(TRACE_BUFFER_SIZE + 4096);
+
+    std::string name = cmd.inputFile;
+    fileName = "\"";
+    if (format == e_traceFormat::ndjson) {
+        for (char c : name) {
+            if (c == '"' || c == '\\') {
+                fileName += '\\';
+                fileName += c;
+            }
+            else if ((unsigned char)c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+                fileName += escaped;
+            }
+            else {
+                fileName += c;
+            }
+        }
+    }
+    else {
+        for (char c : name) {
+            if (c == '"') {
+                fileName += '"';
+            }
+            fileName += c;
+        }
+    }
+    fileName += '"';
+
+    if (format == e_traceFormat::csv && !output.headerWritten.exchange(true)) {
+        buffer += "file,type";
+        for (int i = 0; i < TRACE_COLUMNS; i++) {
+            buffer += ',';
+            buffer += traceColumnNames[i];
+        }
+        buffer += '\n';
+    }
+}
+
+void t_traceWriter::set(e_traceColumn column, int64_t value) {
+    this->value[column] = value;
+    present[column] = true;
+}
+
+void t_traceWriter::appendNumber(int64_t value) {
+    char str[24];
+    char* end = std::to_chars(str, str + sizeof(str), value).ptr;
+    buffer.append(str, end);
+}
+
+void t_traceWriter::appendField(const char* name, int64_t value) {
+    buffer += ",\"";
+    buffer += name;
+    buffer += "\":";
+    appendNumber(value);
+}
+
+void t_traceWriter::appendFlag(const char* name, bool value) {
+    buffer += ",\"";
+    buffer += name;
+    buffer += value ? "\":true" : "\":false";
+}
+
+void t_traceWriter::appendType(uint8_t segmentType) {
+    switch (segmentType) {
+        case e_segmentType::pcs: buffer += "PCS"; break;
+        case e_segmentType::wds: buffer += "WDS"; break;
+        case e_segmentType::pds: buffer += "PDS"; break;
+        case e_segmentType::ods: buffer += "ODS"; break;
+        case e_segmentType::end: buffer += "END"; break;
+        default: {
+            char str[8];
+            std::snprintf(str, sizeof(str), "%#04x", segmentType);
+            buffer += str;
+            break;
+        }
+    }
+}
+
+//A PCS whose composition objects do not fit the segment is traced without its body
+bool pcsFits(const uint8_t* body, size_t size) {
+    if (size < t_pcsLayout::size) {
+        return false;
+    }
+    size_t pos = t_pcsLayout::size;
+    for (int i = 0; i < body[t_pcsLayout::size - 1]; i++) {
+        if (pos + t_compositionObjectLayout::size > size) {
+            return false;
+        }
+        bool cropped = body[pos + 3] & e_objectFlags::cropped;
+        pos += t_compositionObjectLayout::size + (cropped ? t_objectCroppingLayout::size : 0);
+    }
+    return pos <= size;
+}
+
+//Append the record of a segment of the input, body is the segment data after the header
+void t_traceWriter::segment(const t_segment& segment, uint8_t* body) {
+    const t_header& header = segment.header;
+
+    std::fill(present, present + TRACE_COLUMNS, false);
+    set(columnOffset, (int64_t)segment.offset);
+    set(columnPTS, header.pts);
+    set(columnDTS, header.dts);
+    set(columnSize, header.dataLength);
+
+    switch (header.segmentType) {
+    case e_segmentType::pcs:
+        if (pcsFits(body, header.dataLength)) {
+            pcs = t_PCS::read(body);
+            set(columnWidth, pcs.width);
+            set(columnHeight, pcs.height);
+            set(columnCompositionNumber, pcs.compositionNumber);
+            set(columnCompositionState, pcs.compositionState);
+            set(columnPaletteUpdate, pcs.paletteUpdateFlag == 0x80);
+            set(columnPaletteID, pcs.paletteID);
+            set(columnObjects, pcs.numberOfCompositionObjects);
+        }
+        break;
+    case e_segmentType::wds:
+        if (header.dataLength >= t_wdsLayout::size
+            && header.dataLength >= t_wdsLayout::size + (size_t)body[0] * t_windowLayout::size) {
+            wds = t_WDS::read(body);
+            set(columnWindows, wds.numberOfWindows);
+        }
+        break;
+    case e_segmentType::pds:
+        if (header.dataLength >= t_pdsLayout::size) {
+            set(columnPaletteID, body[0]);
+            set(columnVersion, body[1]);
+            set(columnPaletteEntries, (header.dataLength - t_pdsLayout::size) / PALETTE_ENTRY_SIZE);
+        }
+        break;
+    case e_segmentType::ods:
+        if (header.dataLength >= t_odsFragmentLayout::size) {
+            set(columnObjectID, loadBigEndian<uint16_t>(&body[0]));
+            set(columnVersion, body[2]);
+            set(columnSequenceFlag, body[3]);
+        }
+        //The bitmap size is only in the first fragment of the object
+        if (header.dataLength >= t_odsLayout::size && (body[3] & e_sequenceFlag::first)) {
+            t_ODS ods = t_ODS::read(body);
+            set(columnDataLength, ods.dataLength);
+            set(columnWidth, ods.width);
+            set(columnHeight, ods.height);
+        }
+        break;
+    }
+
+    if (format == e_traceFormat::csv) {
+        buffer += fileName;
+        buffer += ',';
+        appendType(header.segmentType);
+        appendCSV();
+    }
+    else {
+        buffer += "{\"file\":";
+        buffer += fileName;
+        buffer += ",\"type\":\"";
+        appendType(header.segmentType);
+        buffer += '"';
+        appendNDJSON(header.segmentType);
+    }
+
+    if (buffer.size() >= TRACE_BUFFER_SIZE) {
+        flush();
+    }
+}
+
+void t_traceWriter::appendCSV() {
+    for (int i = 0; i < TRACE_COLUMNS; i++) {
+        buffer += ',';
+        if (present[i]) {
+            appendNumber(value[i]);
+        }
+    }
+    buffer += '\n';
+}
+
+//Same values of the CSV, the windows and composition objects are listed instead of only counted
+void t_traceWriter::appendNDJSON(uint8_t segmentType) {
+    for (int i = 0; i < TRACE_COLUMNS; i++) {
+        if (!present[i] || i == columnObjects || i == columnWindows) continue;
+
+        if (i == columnPaletteUpdate) {
+            appendFlag(traceColumnNames[i], value[i] != 0);
+        }
+        else {
+            appendField(traceColumnNames[i], value[i]);
+        }
+    }
+
+    if (segmentType == e_segmentType::pcs && present[columnObjects]) {
+        buffer += ",\"objects\":[";
+        for (int i = 0; i < pcs.numberOfCompositionObjects; i++) {
+            const t_compositionObject& object = pcs.compositionObjects[i];
+            buffer += i == 0 ? "{\"object_id\":" : ",{\"object_id\":";
+            appendNumber(object.objectID);
+            appendField("window_id", object.windowID);
+            appendField("x", object.horizontalPosition);
+            appendField("y", object.verticalPosition);
+            appendFlag("forced", object.croppedAndForcedFlag & e_objectFlags::forced);
+            appendFlag("cropped", object.croppedAndForcedFlag & e_objectFlags::cropped);
+            if (object.croppedAndForcedFlag & e_objectFlags::cropped) {
+                appendField("crop_x", object.croppedHorizontalPosition);
+                appendField("crop_y", object.croppedVerticalPosition);
+                appendField("crop_width", object.croppedWidth);
+                appendField("crop_height", object.croppedHeight);
+            }
+            buffer += '}';
+        }
+        buffer += ']';
+    }
+    if (segmentType == e_segmentType::wds && present[columnWindows]) {
+        buffer += ",\"windows\":[";
+        for (int i = 0; i < wds.numberOfWindows; i++) {
+            const t_window& window = wds.windows[i];
+            buffer += i == 0 ? "{\"window_id\":" : ",{\"window_id\":";
+            appendNumber(window.id);
+            appendField("x", window.horizontalPosition);
+            appendField("y", window.verticalPosition);
+            appendField("width", window.width);
+            appendField("height", window.height);
+            buffer += '}';
+        }
+        buffer += ']';
+    }
+
+    buffer += "}\n";
+}
+
+void t_traceWriter::flush() {
+    if (!buffer.empty() && std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+        error = true;
+    }
+    buffer.clear();
+}